@@ -0,0 +1,11 @@
+#ifndef MAIN_ALLOCATIONS_H
+#define MAIN_ALLOCATIONS_H
+
+#include <cstddef>
+
+// the headless runner replaces operator new to count the heap
+// allocations made since the start, and the bytes they asked for
+long allocationCount();
+size_t allocatedBytes();
+
+#endif //MAIN_ALLOCATIONS_H
@@ -0,0 +1,247 @@
+#include "Blend.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BLEND_SSE2
+#include <emmintrin.h>
+#endif
+
+// AVX2 kernel is compiled with a target attribute and picked at runtime,
+// so the rest of the program does not need -mavx2
+#if defined(BLEND_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define BLEND_AVX2
+#include <immintrin.h>
+#endif
+
+
+// mix() works in double precision and truncates the result.
+// for these alphas a*(new - old) is sometimes an exact multiple of 255,
+// but a / 255.0 is rounded down and so is the truncated result.
+// pixels with such alphas are blended by mix() itself to stay bit-exact
+//
+// the list is every alpha for which div255 differs from mix() for some
+// old and new value, found by trying all 256^3 of them; headless
+// --selftest blend compares every kernel with mix() over the same
+// range, so an alpha missing here makes it fail
+static inline bool mixIsInexact(uint8_t a)
+{
+  switch (a)
+  {
+    case 132: case 140: case 147: case 155: case 156:
+    case 171: case 180: case 187: case 195:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static inline uint8_t div255(int t)
+{
+  // exact t / 255 for 0 <= t <= 255 * 255
+  return uint8_t((t + 1 + (t >> 8)) >> 8);
+}
+
+static inline Pixel blendPixel(Pixel oldPixel, Pixel newPixel)
+{
+  if (newPixel.a == 255)
+    return newPixel;
+
+  if (mixIsInexact(newPixel.a))
+    return mix(oldPixel, newPixel);
+
+  int a  = newPixel.a;
+  int na = 255 - a;
+
+  newPixel.r = div255(a * newPixel.r + na * oldPixel.r);
+  newPixel.g = div255(a * newPixel.g + na * oldPixel.g);
+  newPixel.b = div255(a * newPixel.b + na * oldPixel.b);
+  newPixel.a = 255;
+
+  return newPixel;
+}
+
+static void blendRowScalar(Pixel *dst, const Pixel *src, int count)
+{
+  int i = 0;
+  while (i < count)
+  {
+    // opaque spans degenerate to a copy
+    int run = i;
+    while (run < count && src[run].a == 255)
+      ++run;
+
+    if (run > i)
+    {
+      memcpy(dst + i, src + i, (run - i) * sizeof(Pixel));
+      i = run;
+      continue;
+    }
+
+    dst[i] = blendPixel(dst[i], src[i]);
+    ++i;
+  }
+}
+
+#ifdef BLEND_SSE2
+
+static inline __m128i blendHalfSSE2(__m128i d16, __m128i s16)
+{
+  const __m128i c255 = _mm_set1_epi16(255);
+  const __m128i one  = _mm_set1_epi16(1);
+
+  // spread alpha of each of the two pixels over its four channels
+  __m128i a  = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+  __m128i na = _mm_sub_epi16(c255, a);
+
+  // a * new + (255 - a) * old never exceeds 255 * 255 and fits 16 bits
+  __m128i t = _mm_add_epi16(_mm_mullo_epi16(s16, a), _mm_mullo_epi16(d16, na));
+
+  return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(t, one), _mm_srli_epi16(t, 8)), 8);
+}
+
+static void blendRowSSE2(Pixel *dst, const Pixel *src, int count)
+{
+  const __m128i zero      = _mm_setzero_si128();
+  const __m128i alphaMask = _mm_set1_epi32(int(0xFF000000u));
+
+  int i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128i s  = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i sa = _mm_and_si128(s, alphaMask);
+
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(sa, alphaMask)) == 0xFFFF)
+    {
+      _mm_storeu_si128((__m128i *)(dst + i), s);
+      continue;
+    }
+
+    __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(sa, zero)) == 0xFFFF)
+    {
+      _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(d, alphaMask));
+      continue;
+    }
+
+    if (mixIsInexact(src[i].a) || mixIsInexact(src[i + 1].a) ||
+        mixIsInexact(src[i + 2].a) || mixIsInexact(src[i + 3].a))
+    {
+      blendRowScalar(dst + i, src + i, 4);
+      continue;
+    }
+
+    __m128i lo = blendHalfSSE2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero));
+    __m128i hi = blendHalfSSE2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero));
+
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(_mm_packus_epi16(lo, hi), alphaMask));
+  }
+
+  blendRowScalar(dst + i, src + i, count - i);
+}
+
+#endif
+
+#ifdef BLEND_AVX2
+
+__attribute__((target("avx2")))
+static inline __m256i blendHalfAVX2(__m256i d16, __m256i s16)
+{
+  const __m256i c255 = _mm256_set1_epi16(255);
+  const __m256i one  = _mm256_set1_epi16(1);
+
+  __m256i a  = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+  __m256i na = _mm256_sub_epi16(c255, a);
+  __m256i t  = _mm256_add_epi16(_mm256_mullo_epi16(s16, a), _mm256_mullo_epi16(d16, na));
+
+  return _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(t, one), _mm256_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+static void blendRowAVX2(Pixel *dst, const Pixel *src, int count)
+{
+  const __m256i zero      = _mm256_setzero_si256();
+  const __m256i alphaMask = _mm256_set1_epi32(int(0xFF000000u));
+
+  int i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m256i s  = _mm256_loadu_si256((const __m256i *)(src + i));
+    __m256i sa = _mm256_and_si256(s, alphaMask);
+
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(sa, alphaMask)) == -1)
+    {
+      _mm256_storeu_si256((__m256i *)(dst + i), s);
+      continue;
+    }
+
+    __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(sa, zero)) == -1)
+    {
+      _mm256_storeu_si256((__m256i *)(dst + i), _mm256_or_si256(d, alphaMask));
+      continue;
+    }
+
+    bool inexact = false;
+    for (int k = 0; k < 8; ++k)
+      inexact |= mixIsInexact(src[i + k].a);
+
+    if (inexact)
+    {
+      blendRowScalar(dst + i, src + i, 8);
+      continue;
+    }
+
+    // unpack and pack both work inside 128-bit lanes, so pixel order is kept
+    __m256i lo = blendHalfAVX2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero));
+    __m256i hi = blendHalfAVX2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero));
+
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_or_si256(_mm256_packus_epi16(lo, hi), alphaMask));
+  }
+
+  blendRowSSE2(dst + i, src + i, count - i);
+}
+
+#endif
+
+
+static BlendKernel selectKernel()
+{
+#ifdef BLEND_AVX2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return {blendRowAVX2, "avx2"};
+#endif
+#ifdef BLEND_SSE2
+  return {blendRowSSE2, "sse2"};
+#else
+  return {blendRowScalar, "scalar"};
+#endif
+}
+
+static const BlendKernel kernel = selectKernel();
+
+
+void BlendRow(Pixel *dst, const Pixel *src, int count)
+{
+  kernel.row(dst, src, count);
+}
+
+const char *BlendBackend()
+{
+  return kernel.name;
+}
+
+std::vector<BlendKernel> BlendKernels()
+{
+  std::vector<BlendKernel> kernels{kernel};
+#ifdef BLEND_AVX2
+  if (kernel.row != blendRowSSE2)
+    kernels.push_back({blendRowSSE2, "sse2"});
+#endif
+  if (kernel.row != blendRowScalar)
+    kernels.push_back({blendRowScalar, "scalar"});
+  return kernels;
+}
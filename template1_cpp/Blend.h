@@ -0,0 +1,31 @@
+#ifndef MAIN_BLEND_H
+#define MAIN_BLEND_H
+
+#include "Image.h"
+
+#include <vector>
+
+// blends a row of count source pixels over dst, producing exactly
+// what calling mix() on every pixel would (alpha of dst becomes 255)
+//
+// fully opaque spans are copied, fully transparent spans only get
+// their alpha set, everything else goes through integer math,
+// 8 pixels at a time with AVX2 or 4 with SSE2 when available
+void BlendRow(Pixel *dst, const Pixel *src, int count);
+
+// name of the kernel picked at startup ("avx2", "sse2" or "scalar")
+const char *BlendBackend();
+
+typedef void (*BlendRowFn)(Pixel *dst, const Pixel *src, int count);
+
+struct BlendKernel
+{
+  BlendRowFn  row;
+  const char *name;
+};
+
+// every kernel this build and CPU can run, the picked one first,
+// so each of them can be checked against mix()
+std::vector<BlendKernel> BlendKernels();
+
+#endif //MAIN_BLEND_H
@@ -0,0 +1,100 @@
+#include "Camera.h"
+
+#include <cstdlib>
+#include <cstring>
+
+Camera::Camera(int a_width, int a_height) : width(a_width), height(a_height)
+{
+}
+
+void Camera::setWorld(int a_width, int a_height)
+{
+  world_width = a_width;
+  world_height = a_height;
+  clamp();
+}
+
+void Camera::clamp()
+{
+  x = x < world_width - width ? x : world_width - width;
+  y = y < world_height - height ? y : world_height - height;
+  x = x > 0 ? x : 0;
+  y = y > 0 ? y : 0;
+}
+
+void Camera::follow(const Rect &target)
+{
+  int lo_x = x + width / 3,  hi_x = x + width - width / 3,
+      lo_y = y + height / 3, hi_y = y + height - height / 3;
+
+  if (target.x < lo_x)
+    x -= lo_x - target.x;
+  else if (target.x + target.w > hi_x)
+    x += target.x + target.w - hi_x;
+
+  if (target.y < lo_y)
+    y -= lo_y - target.y;
+  else if (target.y + target.h > hi_y)
+    y += target.y + target.h - hi_y;
+
+  clamp();
+}
+
+void Camera::jump(const Rect &target)
+{
+  x = target.x + target.w / 2 - width / 2;
+  y = target.y + target.h / 2 - height / 2;
+  clamp();
+
+  shown_x = x;
+  shown_y = y;
+}
+
+bool Camera::scroll(Image &screen, DirtyRegions &dirty)
+{
+  int dx = x - shown_x,
+      dy = y - shown_y;
+
+  if (dx == 0 && dy == 0)
+    return false;
+
+  shown_x = x;
+  shown_y = y;
+
+  if (abs(dx) >= width || abs(dy) >= height)
+  {
+    dirty.addAll();
+    return true;
+  }
+
+  // marks made for the old position move with the pixels
+  for (const Rect &r : dirty.collect())
+    dirty.add(Rect{r.x - dx, r.y - dy, r.w, r.h});
+
+  // screen pixel (sx, sy) now shows what was at (sx + dx, sy + dy);
+  // rows are walked so that a source row is read before it is overwritten
+  int count = width - abs(dx);
+  int to_x = dx < 0 ? -dx : 0,
+      from_x = dx > 0 ? dx : 0;
+  int rows = height - abs(dy);
+
+  for (int i = 0; i < rows; ++i)
+  {
+    int sy = dy > 0 ? i : height - 1 - i;
+    Pixel *row = screen.Data() + sy * screen.Width();
+    const Pixel *from = screen.Data() + (sy + dy) * screen.Width();
+    memmove(row + to_x, from + from_x, count * sizeof(Pixel));
+  }
+
+  if (dx > 0)
+    dirty.add(Rect{width - dx, 0, dx, height});
+  else if (dx < 0)
+    dirty.add(Rect{0, 0, -dx, height});
+
+  if (dy > 0)
+    dirty.add(Rect{0, height - dy, width, dy});
+  else if (dy < 0)
+    dirty.add(Rect{0, 0, width, -dy});
+
+  return true;
+}
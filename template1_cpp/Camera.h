@@ -0,0 +1,55 @@
+#ifndef MAIN_CAMERA_H
+#define MAIN_CAMERA_H
+
+#include "Image.h"
+#include "DirtyRegions.h"
+
+// the part of the world (in world pixels) shown on the screen.
+// the framebuffer keeps what was drawn for the last shown position;
+// when the camera moves it is shifted instead of being redrawn and
+// only the strips that came into view are repainted
+class Camera
+{
+public:
+  // viewport size in pixels
+  Camera(int a_width, int a_height);
+
+  // size of the world in pixels; the view does not leave it,
+  // a world smaller than the viewport stays in the corner
+  void setWorld(int a_width, int a_height);
+
+  // moves the view just enough to keep the target
+  // inside the middle third of the screen
+  void follow(const Rect &target);
+
+  // centers the view on the target at once; the caller
+  // repaints the whole screen, so nothing is scrolled
+  void jump(const Rect &target);
+
+  // world position of the screen's corner as the framebuffer shows it
+  int originX() const { return shown_x; }
+  int originY() const { return shown_y; }
+
+  // world rectangle covered by the framebuffer
+  Rect shown() const { return Rect{shown_x, shown_y, width, height}; }
+
+  Rect toScreen(const Rect &r) const { return Rect{r.x - shown_x, r.y - shown_y, r.w, r.h}; }
+  Rect toWorld(const Rect &r) const { return Rect{r.x + shown_x, r.y + shown_y, r.w, r.h}; }
+
+  // shifts the framebuffer to the current view, moving pending dirty
+  // marks along with it and marking the uncovered strips;
+  // returns true if the screen contents moved
+  bool scroll(Image &screen, DirtyRegions &dirty);
+
+private:
+  void clamp();
+
+  int width;
+  int height;
+  int world_width = 0;
+  int world_height = 0;
+  int x = 0, y = 0;             // where the view should be
+  int shown_x = 0, shown_y = 0; // what the framebuffer shows
+};
+
+#endif //MAIN_CAMERA_H
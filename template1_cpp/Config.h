@@ -0,0 +1,26 @@
+#ifndef MAIN_CONFIG_H
+#define MAIN_CONFIG_H
+
+#include "Image.h"
+
+constexpr int WINDOW_WIDTH  = 1024,
+              WINDOW_HEIGHT = 1024,
+              BORDER_MARGIN = 4;
+
+constexpr int X_TILES = WINDOW_WIDTH  / tileSize,
+              Y_TILES = WINDOW_HEIGHT / tileSize;
+
+// the window shows X_TILES x Y_TILES, maps may be bigger
+// in each direction up to MAX_MAP_TILES
+constexpr int MAX_MAP_TILES = 16384;
+
+constexpr int N_LEVELS = 2;
+
+// the game is simulated at a fixed rate,
+// counters below are in simulation ticks
+constexpr int TICKS_PER_SECOND = 60;
+constexpr int ANIMATION_FREQUENCY = 50;
+constexpr int SMASH_COOLDOWN = 100; // wall smashing cooldown 
+                                    // (player is unable to break walls during cooldown)
+
+#endif //MAIN_CONFIG_H
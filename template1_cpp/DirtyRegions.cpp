@@ -0,0 +1,141 @@
+#include "DirtyRegions.h"
+
+#include <algorithm>
+
+DirtyRegions::DirtyRegions(int a_width, int a_height) :
+  cols((a_width + tileSize - 1) / tileSize),
+  rows((a_height + tileSize - 1) / tileSize),
+  words((cols + 63) / 64),
+  bits(rows * words, 0)
+{
+}
+
+void DirtyRegions::markRow(int ty, int tx0, int tx1)
+{
+  uint64_t *row = bits.data() + ty * words;
+
+  for (int w = tx0 / 64; w <= (tx1 - 1) / 64; ++w)
+  {
+    int lo = std::max(tx0 - w * 64, 0);
+    int hi = std::min(tx1 - w * 64, 64);
+    uint64_t mask = hi - lo == 64 ? ~0ull : ((1ull << (hi - lo)) - 1) << lo;
+    row[w] |= mask;
+  }
+}
+
+void DirtyRegions::add(const Rect &r)
+{
+  Rect visible = Intersect(r, Rect{0, 0, cols * tileSize, rows * tileSize});
+  if (visible.Empty())
+    return;
+
+  int tx0 = visible.x / tileSize,
+      ty0 = visible.y / tileSize,
+      tx1 = (visible.x + visible.w + tileSize - 1) / tileSize,
+      ty1 = (visible.y + visible.h + tileSize - 1) / tileSize;
+
+  for (int ty = ty0; ty < ty1; ++ty)
+    markRow(ty, tx0, tx1);
+}
+
+void DirtyRegions::addTile(int tx, int ty)
+{
+  if (tx < 0 || ty < 0 || tx >= cols || ty >= rows)
+    return;
+
+  bits[ty * words + tx / 64] |= 1ull << (tx % 64);
+}
+
+void DirtyRegions::addAll()
+{
+  for (int ty = 0; ty < rows; ++ty)
+    markRow(ty, 0, cols);
+}
+
+bool DirtyRegions::empty() const
+{
+  for (uint64_t w : bits)
+    if (w != 0)
+      return false;
+  return true;
+}
+
+bool DirtyRegions::intersects(const Rect &r) const
+{
+  Rect visible = Intersect(r, Rect{0, 0, cols * tileSize, rows * tileSize});
+  if (visible.Empty())
+    return false;
+
+  int tx0 = visible.x / tileSize,
+      ty0 = visible.y / tileSize,
+      tx1 = (visible.x + visible.w + tileSize - 1) / tileSize,
+      ty1 = (visible.y + visible.h + tileSize - 1) / tileSize;
+
+  for (int ty = ty0; ty < ty1; ++ty)
+    for (int tx = tx0; tx < tx1; ++tx)
+      if (bits[ty * words + tx / 64] >> (tx % 64) & 1)
+        return true;
+
+  return false;
+}
+
+const std::vector<Rect> &DirtyRegions::collect()
+{
+  rects.clear();
+  open.clear();
+  last_pixels = 0;
+
+  // each row is split into runs of dirty tiles; a run continues
+  // the rectangle above it if that one spans exactly the same tiles
+  for (int ty = 0; ty < rows; ++ty)
+  {
+    const uint64_t *row = bits.data() + ty * words;
+    size_t above = 0;
+    next_open.clear();
+
+    int tx = 0;
+    while (tx < cols)
+    {
+      uint64_t w = row[tx / 64] >> (tx % 64);
+      if (w == 0)
+      {
+        tx = (tx / 64 + 1) * 64;
+        continue;
+      }
+      if ((w & 1) == 0)
+      {
+        ++tx;
+        continue;
+      }
+
+      int start = tx;
+      while (tx < cols && (row[tx / 64] >> (tx % 64) & 1))
+        ++tx;
+
+      while (above < open.size() && rects[open[above]].x < start)
+        ++above;
+
+      if (above < open.size() && rects[open[above]].x == start && rects[open[above]].w == tx - start)
+      {
+        rects[open[above]].h++;
+        next_open.push_back(open[above]);
+      }
+      else
+      {
+        next_open.push_back(int(rects.size()));
+        rects.push_back(Rect{start, ty, tx - start, 1});
+      }
+    }
+
+    open.swap(next_open);
+  }
+
+  for (Rect &r : rects)
+  {
+    r = Rect{r.x * tileSize, r.y * tileSize, r.w * tileSize, r.h * tileSize};
+    last_pixels += size_t(r.w) * r.h;
+  }
+
+  std::fill(bits.begin(), bits.end(), 0);
+  return rects;
+}
@@ -0,0 +1,48 @@
+#ifndef MAIN_DIRTYREGIONS_H
+#define MAIN_DIRTYREGIONS_H
+
+#include "Image.h"
+
+#include <cstdint>
+#include <vector>
+
+// collects the parts of the screen that changed during a frame
+// with tile granularity (one bit per tile) and turns them into a
+// small set of disjoint rectangles for repainting and uploading
+class DirtyRegions
+{
+public:
+  // screen size in pixels
+  DirtyRegions(int a_width, int a_height);
+
+  // marks every tile touched by the rectangle (in pixels)
+  void add(const Rect &r);
+  void addTile(int tx, int ty);
+  void addAll();
+
+  bool empty() const;
+
+  // true if any tile under the rectangle is marked
+  bool intersects(const Rect &r) const;
+
+  // merged rectangles in pixels, clears the marks;
+  // stays valid until the next call
+  const std::vector<Rect> &collect();
+
+  // pixels covered by the last collect()
+  size_t pixels() const { return last_pixels; }
+
+private:
+  void markRow(int ty, int tx0, int tx1);
+
+  int cols;
+  int rows;
+  int words; // words per row
+  std::vector<uint64_t> bits;
+
+  std::vector<Rect> rects;
+  std::vector<int> open, next_open;
+  size_t last_pixels = 0;
+};
+
+#endif //MAIN_DIRTYREGIONS_H
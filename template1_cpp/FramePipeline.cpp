@@ -0,0 +1,174 @@
+#include "FramePipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+constexpr int FramePipeline::MAX_DEPTH;
+
+// a framebuffer missing more rectangles than this is copied whole
+static const size_t MAX_STALE_RECTS = 64;
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+FramePipeline::FramePipeline(int a_width, int a_height, int a_depth, Present a_present,
+                             std::function<void()> start, std::function<void()> stop, Clock a_clock) :
+  slots(std::max(1, std::min(a_depth, MAX_DEPTH))), present(std::move(a_present)),
+  on_start(std::move(start)), on_stop(std::move(stop)), clock(std::move(a_clock))
+{
+  if (!clock)
+    clock = []() { return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count(); };
+
+  // a single frame in flight is shown straight from the screen
+  if (slots.size() > 1)
+    for (Slot &slot : slots)
+      slot.pixels = Image(a_width, a_height, 4);
+
+  worker = std::thread([this]() { presentLoop(); });
+}
+
+FramePipeline::~FramePipeline()
+{
+  finish();
+}
+
+void FramePipeline::submit(const Image &screen, const std::vector<Rect> &changed, const std::vector<double> &inputs)
+{
+  queue(screen, &changed, inputs);
+}
+
+void FramePipeline::submitAll(const Image &screen, const std::vector<double> &inputs)
+{
+  queue(screen, nullptr, inputs);
+}
+
+LatencyHistogram FramePipeline::inputLatency()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return latency;
+}
+
+void FramePipeline::queue(const Image &screen, const std::vector<Rect> *changed, const std::vector<double> &inputs)
+{
+  auto wait_start = std::chrono::steady_clock::now();
+  {
+    std::unique_lock<std::mutex> locked(lock);
+    freed.wait(locked, [&]() { return in_flight < depth(); });
+  }
+  stats.add(StageStats::WAIT, secondsSince(wait_start));
+
+  auto copy_start = std::chrono::steady_clock::now();
+  Slot &slot = slots[next_free];
+  Rect all = Rect{0, 0, screen.Width(), screen.Height()};
+  slot.frame = depth() == 1 ? &screen : &slot.pixels;
+
+  // the other framebuffers miss these pixels from now on
+  for (Slot &other : slots)
+  {
+    if (&other == &slot || other.all_stale)
+      continue;
+    if (changed == nullptr || other.stale.size() + changed->size() > MAX_STALE_RECTS)
+      other.all_stale = true;
+    else
+      other.stale.insert(other.stale.end(), changed->begin(), changed->end());
+  }
+
+  if (changed != nullptr && !slot.all_stale)
+    slot.stale.insert(slot.stale.end(), changed->begin(), changed->end());
+  else
+    slot.stale.assign(1, all);
+
+  for (const Rect &r : slot.stale)
+  {
+    Rect visible = Intersect(r, all);
+    for (int y = visible.y; y < visible.y + visible.h && slot.frame != &screen; ++y)
+    {
+      size_t offset = size_t(y) * screen.Width() + visible.x;
+      memcpy(slot.pixels.Data() + offset, screen.Data() + offset, visible.w * sizeof(Pixel));
+    }
+  }
+  slot.stale.clear();
+  slot.all_stale = false;
+
+  slot.whole = changed == nullptr;
+  if (changed != nullptr)
+    slot.changed = *changed;
+  slot.inputs = inputs;
+  stats.add(StageStats::COPY, secondsSince(copy_start));
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    next_free = (next_free + 1) % depth();
+    in_flight++;
+  }
+  filled.notify_one();
+
+  // nothing overlaps, the frame is on the screen before the next one starts
+  if (depth() == 1)
+    flush();
+}
+
+void FramePipeline::flush()
+{
+  std::unique_lock<std::mutex> locked(lock);
+  freed.wait(locked, [&]() { return in_flight == 0; });
+}
+
+void FramePipeline::finish()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (finished)
+      return;
+    finished = true;
+  }
+
+  flush();
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  filled.notify_one();
+  worker.join();
+}
+
+void FramePipeline::presentLoop()
+{
+  if (on_start)
+    on_start();
+
+  std::vector<Rect> whole;
+  for (;;)
+  {
+    Slot *slot;
+    {
+      std::unique_lock<std::mutex> locked(lock);
+      filled.wait(locked, [&]() { return stopping || in_flight > 0; });
+      if (in_flight == 0)
+        break;
+      slot = &slots[next_shown];
+    }
+
+    // the framebuffer stays in flight, and untouched, until it is shown
+    auto start = std::chrono::steady_clock::now();
+    whole.assign(1, Rect{0, 0, slot->frame->Width(), slot->frame->Height()});
+    last_upload = present(*slot->frame, slot->whole ? whole : slot->changed);
+    stats.add(StageStats::PRESENT, secondsSince(start));
+    double shown = slot->inputs.empty() ? 0.0 : clock();
+
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      for (double input : slot->inputs)
+        latency.add(shown - input);
+      next_shown = (next_shown + 1) % depth();
+      in_flight--;
+    }
+    freed.notify_all();
+  }
+
+  if (on_stop)
+    on_stop();
+}
@@ -0,0 +1,106 @@
+#ifndef MAIN_FRAMEPIPELINE_H
+#define MAIN_FRAMEPIPELINE_H
+
+#include "Image.h"
+#include "Stats.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// hands finished frames from the game thread to a presenting thread
+// through a ring of framebuffers, so the next frame is simulated and
+// drawn while the one before is uploaded and shown
+//
+// a framebuffer only gets the pixels that changed since it was last
+// used, the rest of it is already the same as the screen. depth is how
+// many frames may be in flight: 1 shows every frame before submit()
+// returns (least latency), 2 or 3 let the stages overlap (more frames
+// a second, each of them shown that much later)
+class FramePipeline
+{
+public:
+  // shows a frame, changed are the rectangles that differ from the
+  // frame before; returns the bytes uploaded
+  typedef std::function<size_t(const Image &frame, const std::vector<Rect> &changed)> Present;
+  // the clock input events are stamped with, in seconds
+  typedef std::function<double()> Clock;
+
+  static constexpr int MAX_DEPTH = 3;
+
+  // start and stop run on the presenting thread, before the first
+  // frame and after the last one (to take and release a GL context);
+  // without a clock inputs are timed on std::chrono::steady_clock
+  FramePipeline(int a_width, int a_height, int a_depth, Present a_present,
+                std::function<void()> start = nullptr, std::function<void()> stop = nullptr,
+                Clock a_clock = nullptr);
+  // shows the frames still queued
+  ~FramePipeline();
+
+  FramePipeline(const FramePipeline &) = delete;
+  FramePipeline& operator=(const FramePipeline &) = delete;
+
+  // queues the screen, waiting for a framebuffer if all are in flight;
+  // inputs are the times of the input events the frame is the first to
+  // show, their latency is taken when it has been presented
+  void submit(const Image &screen, const std::vector<Rect> &changed,
+              const std::vector<double> &inputs = std::vector<double>());
+  void submitAll(const Image &screen, const std::vector<double> &inputs = std::vector<double>());
+
+  // returns when every frame submitted is shown
+  void flush();
+  // flushes and stops the presenting thread
+  void finish();
+
+  int depth() const { return int(slots.size()); }
+  size_t lastUploadBytes() const { return last_upload; }
+
+  // copy, wait and present times; only read them after finish()
+  const StageStats &stages() const { return stats; }
+
+  // input latency of the frames presented so far, may be read any time
+  LatencyHistogram inputLatency();
+
+private:
+  struct Slot
+  {
+    Image pixels;
+    // what the presenting thread shows
+    const Image *frame = nullptr;  // pixels, or the screen itself
+    std::vector<Rect> changed;
+    bool whole = true;
+    std::vector<double> inputs;
+    // changed by the frames since this framebuffer was filled,
+    // only used by the game thread
+    std::vector<Rect> stale;
+    bool all_stale = true;
+  };
+
+  void queue(const Image &screen, const std::vector<Rect> *changed, const std::vector<double> &inputs);
+  void presentLoop();
+
+  std::vector<Slot> slots;
+  Present present;
+  std::function<void()> on_start;
+  std::function<void()> on_stop;
+  Clock clock;
+
+  std::mutex lock;
+  std::condition_variable freed;   // a frame was shown
+  std::condition_variable filled;  // a frame was queued
+  int next_free = 0;   // filled next by the game thread
+  int next_shown = 0;  // shown next
+  int in_flight = 0;
+  bool stopping = false;
+  bool finished = false;
+
+  StageStats stats;
+  LatencyHistogram latency;  // under lock
+  std::atomic<size_t> last_upload{0};
+  std::thread worker;
+};
+
+#endif //MAIN_FRAMEPIPELINE_H
@@ -0,0 +1,333 @@
+#include "Game.h"
+
+std::string levelPath(int n) {
+  // a converted level is used if there is one
+  std::string path = "../resources/levels/" + std::to_string(n);
+  FILE *f = fopen((path + ".lvl").c_str(), "rb");
+  if (f != nullptr) {
+    fclose(f);
+    return path + ".lvl";
+  }
+  return path + ".txt";
+}
+
+std::string generateMap(int width, int height) {
+  std::string text = "; generated " + std::to_string(width) + "x" + std::to_string(height) + " map\n";
+  text.reserve(text.size() + size_t(height) * (width + 1));
+
+  uint32_t seed = 1;
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      seed = seed * 1664525u + 1013904223u;
+      unsigned v = seed >> 24;
+      if (x == 0 || y == 0 || x == width - 1 || y == height - 1 || v < 8) {
+        text += '#';
+      } else if (x == width / 2 && y == height / 2) {
+        text += '@';
+      } else if (x == width / 2 + 1 && y == height / 2) {
+        text += 'x';
+      } else {
+        text += v < 20 ? '%' : v < 22 ? ' ' : '.';
+      }
+    }
+    text += '\n';
+  }
+  return text;
+}
+
+// a file name given as a string literal needs no allocation
+static Image tileImage(const char *overlay) {
+  Image tile("../resources/tiles/floor.png");
+  if (*overlay != '\0') {
+    Image(overlay).Draw(tile);
+  }
+  return tile;
+}
+
+void loadTiles(TileAtlas &tiles, JobSystem *jobs) {
+  static const struct {
+    char sym;
+    const char *overlay;
+  } files[] = {
+    {'.', ""},
+    {' ', "../resources/tiles/space_1.png"},
+    {'*', "../resources/tiles/space_2.png"},
+    {'x', "../resources/tiles/exit.png"},
+    {'#', "../resources/tiles/unbreakable_wall.png"},
+    {'%', "../resources/tiles/breakable_wall.png"},
+    // broken wall appears
+    // after breaking a breakable wall.
+    {'b', "../resources/tiles/broken_wall.png"},
+  };
+  const int n = sizeof(files) / sizeof(files[0]);
+
+  // the images are decoded at the same time,
+  // then put into the atlas in order
+  Image images[n];
+  auto decode = [&](int from, int to) {
+    for (int i = from; i < to; ++i) {
+      images[i] = tileImage(files[i].overlay);
+    }
+  };
+  if (jobs != nullptr) {
+    jobs->parallelFor(0, n, 1, decode);
+  } else {
+    decode(0, n);
+  }
+
+  for (int i = 0; i < n; ++i) {
+    tiles.add(files[i].sym, images[i]);
+  }
+}
+
+bool mayGo(int x, int y, MovementDir dir, LevelMap &Level) {
+
+  // if % tileSize != 0
+  // then two blocks above/below/to the left/to the right
+  // are on the player's way
+  // otherwise there is only one obstacle
+  bool x2 = x % tileSize != 0,
+       y2 = y % tileSize != 0;
+
+  int xt = x / tileSize, // x_tiles
+      yt = y / tileSize; // y_tiles
+
+  // tiles in the player's way are checked against
+  // the solid plane with a single mask per row
+  switch(dir)
+  {
+    case MovementDir::UP:
+      if (y + tileSize >= Level.height() * tileSize - BORDER_MARGIN) {
+        return false;
+      }
+
+      return !Level.any(SOLID, xt, yt + 1, xt + x2, yt + 1);
+
+    case MovementDir::DOWN:
+      if (y <= BORDER_MARGIN) {
+        return false;
+      }
+
+      // the player is far enough from the next tile below
+      if (y2) {
+        return true;
+      }
+
+      return !Level.any(SOLID, xt, yt - 1, xt + x2, yt - 1);
+    
+    case MovementDir::LEFT:
+      if (x <= BORDER_MARGIN) {
+        return false;
+      }
+
+      // the player is far enough from the next tile to the left
+      if (x2) {
+        return true;
+      }
+
+      return !Level.any(SOLID, xt - 1, yt, xt - 1, yt + y2);
+    
+    case MovementDir::RIGHT:
+      if (x + tileSize >= Level.width() * tileSize - BORDER_MARGIN) {
+        return false;
+      }
+
+      return !Level.any(SOLID, xt + 1, yt, xt + 1, yt + y2);
+    
+    default:
+      break;
+  }
+
+  return true;
+}
+
+void breakWall(Player &player, LevelMap &Level) {
+  // check the tile the player is standing on right now
+  auto coords = player.getCoords();
+  int x = coords.x;
+  int y = coords.y;
+
+  // choosing the tile covered by the
+  // biggest fraction of player tile's
+  // square area
+  x = x / tileSize + int(x % tileSize > tileSize / 2);
+  y = y / tileSize + int(y % tileSize > tileSize / 2);
+
+  unsigned walls = Level.neighbours(BREAKABLE, x, y);
+  if (walls == 0) {
+    return;
+  }
+
+  if (walls & NEIGHBOUR_LEFT) {
+    Level.set(x - 1,y,'b');
+  }
+  if (walls & NEIGHBOUR_RIGHT) {
+    Level.set(x + 1,y,'b');
+  }
+  if (walls & NEIGHBOUR_DOWN) {
+    Level.set(x,y - 1,'b');
+  }
+  if (walls & NEIGHBOUR_UP) {
+    Level.set(x,y + 1,'b');
+  }
+  player.smash_cooldown = SMASH_COOLDOWN;
+}
+
+void processPlayerMovement(Player &player, LevelMap &Level, const Controls &controls) {
+  auto coords = player.getCoords();
+  int x = coords.x;
+  int y = coords.y;
+
+  if (player.smash_cooldown > 0) {
+    player.smash_cooldown--;
+  }
+
+  if (controls.up) { 
+    auto dir = MovementDir::UP;
+    if (mayGo(x,y,dir,Level)) {
+      player.ProcessInput(dir);
+    }
+  }
+
+  if (controls.down) {
+    auto dir = MovementDir::DOWN;
+    if (mayGo(x,y,dir,Level)) {
+      player.ProcessInput(dir);
+    }
+  }
+  
+  if (controls.left) {
+    auto dir = MovementDir::LEFT;
+    if (mayGo(x,y,dir,Level)) {
+      player.ProcessInput(dir);
+    }
+    player.changeDir(MovementDir::LEFT);
+  }
+  
+  if (controls.right) {
+    auto dir = MovementDir::RIGHT;
+    if (mayGo(x,y,dir,Level)) {
+      player.ProcessInput(dir);
+    }
+    player.changeDir(MovementDir::RIGHT);
+  }
+
+  if (controls.smash && player.smash_cooldown == 0) {
+    breakWall(player, Level);
+  }
+
+  // check the tile the player is standing on right now
+  coords = player.getCoords();
+  x = coords.x;
+  y = coords.y;
+
+  // choosing the tile covered by the
+  // biggest fraction of player tile's
+  // square area
+  x = x / tileSize + int(x % tileSize > tileSize / 2);
+  y = y / tileSize + int(y % tileSize > tileSize / 2);
+
+  if (Level.test(DEADLY, x, y)) {
+    player.status = playerStatus::DEAD;
+  } else if (Level.test(EXIT, x, y)) {
+    player.status = playerStatus::ESCAPED;
+  }
+
+}
+
+void simulateTick(Player &player, LevelMap &Level, const Controls &controls) {
+  player.beginTick();
+  processPlayerMovement(player, Level, controls);
+  Level.animation();
+}
+
+void placePlayer(Player &player, double alpha, Camera &camera, DirtyRegions &dirty) {
+  Rect before = player.bounds();
+  bool turned = player.turned();
+  player.interpolate(alpha);
+  Rect after = player.bounds();
+
+  if (before.x != after.x || before.y != after.y || turned) {
+    dirty.add(camera.toScreen(before));
+    dirty.add(camera.toScreen(after));
+  }
+
+  camera.follow(after);
+}
+
+const std::vector<Rect> &repaint(Image &screen, LevelMap &Level, const TileAtlas &tiles, Player &player,
+                                 const Camera &camera, DirtyRegions &dirty, JobSystem *jobs) {
+  Rect sprite = camera.toScreen(player.bounds());
+  bool player_hit = dirty.intersects(sprite);
+
+  // the whole sprite has to be covered by the repainted area
+  if (player_hit) {
+    dirty.add(sprite);
+  }
+
+  const std::vector<Rect> &rects = dirty.collect();
+  for (const Rect &r : rects) {
+    Level.drawArea(screen, tiles, r, jobs);
+  }
+
+  if (player_hit) {
+    player.Draw(screen, Point{camera.originX(), camera.originY()});
+  }
+
+  return rects;
+}
+
+void showLevel(const LevelMap &Level, Player &player, Camera &camera) {
+  camera.setWorld(Level.width() * tileSize, Level.height() * tileSize);
+  camera.jump(player.bounds());
+}
+
+Checkpoint takeCheckpoint(const LevelMap &Level, const Player &player) {
+  return Checkpoint{Level.snapshot(), player.getCoords()};
+}
+
+void restoreCheckpoint(LevelMap &Level, Player &player, const Checkpoint &checkpoint, Camera &camera, DirtyRegions &dirty) {
+  // only the tiles changed since the checkpoint are marked
+  Level.restore(checkpoint.level);
+
+  Rect before = player.bounds();
+  player.status = playerStatus::OK;
+  player.smash_cooldown = 0;
+  player.setPos(checkpoint.player_pos.x, checkpoint.player_pos.y);
+  player.setOldPos(checkpoint.player_pos.x, checkpoint.player_pos.y);
+
+  Rect view = camera.shown();
+  camera.jump(player.bounds());
+  if (camera.originX() != view.x || camera.originY() != view.y) {
+    dirty.addAll();
+  } else {
+    dirty.add(camera.toScreen(before));
+    dirty.add(camera.toScreen(player.bounds()));
+  }
+}
+
+void restartLevel(LevelMap &Level, Player &player, Point starting_pos, Camera &camera, DirtyRegions &dirty) {
+  restoreCheckpoint(Level, player, Checkpoint{LevelMap::Snapshot(), starting_pos}, camera, dirty);
+}
+
+LevelMap &startLevel(LevelSet &levels, Player &player, int n, Image &screen, Camera &camera, DirtyRegions &dirty) {
+  // nothing changes if level n can not be opened
+  LevelMap &next = levels.advance(n);
+
+  Point starting_pos = levels.start();
+  player.setPos(starting_pos.x, starting_pos.y);
+  player.setOldPos(starting_pos.x, starting_pos.y);
+  player.status = playerStatus::OK;
+  player.smash_cooldown = 0;
+
+  showLevel(next, player, camera);
+
+  // the level was drawn while the last one was played,
+  // only the player is missing
+  if (levels.takeBackground(screen, camera.shown())) {
+    dirty.add(camera.toScreen(player.bounds()));
+  } else {
+    dirty.addAll();
+  }
+  return next;
+}
@@ -0,0 +1,84 @@
+#ifndef MAIN_GAME_H
+#define MAIN_GAME_H
+
+#include "Config.h"
+#include "LevelMap.h"
+#include "LevelSet.h"
+#include "Player.h"
+#include "TileAtlas.h"
+#include "DirtyRegions.h"
+#include "Camera.h"
+
+#include <string>
+#include <vector>
+
+// what the player asks for during a frame,
+// filled from the keyboard or from a script
+struct Controls
+{
+  bool up    = false;
+  bool down  = false;
+  bool left  = false;
+  bool right = false;
+  bool smash = false;
+  bool rewind = false; // goes back in time instead of playing
+};
+
+// the level's world file (.lvl) if it was converted, its text otherwise
+std::string levelPath(int n);
+
+// text of a map with walls around, random walls, breakable walls and
+// space inside, a comment on top and the player in the middle with an
+// exit next to it; the same map every time for the same size
+std::string generateMap(int width, int height);
+
+// every tile is drawn on top of the floor,
+// the images are decoded on the threads of jobs if it is given
+void loadTiles(TileAtlas &tiles, JobSystem *jobs = nullptr);
+
+bool mayGo(int x, int y, MovementDir dir, LevelMap &Level);
+void breakWall(Player &player, LevelMap &Level);
+void processPlayerMovement(Player &player, LevelMap &Level, const Controls &controls);
+
+// one fixed simulation step
+void simulateTick(Player &player, LevelMap &Level, const Controls &controls);
+
+// puts the player's sprite between its positions before and after
+// the last tick, marks where it was and where it is now
+// and lets the camera follow it
+void placePlayer(Player &player, double alpha, Camera &camera, DirtyRegions &dirty);
+
+// repaint everything marked dirty, the player is drawn again
+// if its tiles were repainted; returns the repainted rectangles.
+// big rectangles are split into bands drawn on the threads of jobs
+const std::vector<Rect> &repaint(Image &screen, LevelMap &Level, const TileAtlas &tiles, Player &player,
+                                 const Camera &camera, DirtyRegions &dirty, JobSystem *jobs = nullptr);
+
+// fits the camera to a freshly loaded level and centers it on the player
+void showLevel(const LevelMap &Level, Player &player, Camera &camera);
+
+// the level and the player at some moment; the level's tiles
+// are shared with the map until either of them changes
+struct Checkpoint
+{
+  LevelMap::Snapshot level;
+  Point player_pos;
+};
+
+Checkpoint takeCheckpoint(const LevelMap &Level, const Player &player);
+
+// goes back to the checkpoint: only the tiles changed since then
+// and the player are repainted, unless the camera has to move
+void restoreCheckpoint(LevelMap &Level, Player &player, const Checkpoint &checkpoint, Camera &camera, DirtyRegions &dirty);
+
+// replaying current level: the level goes back to how it was read
+// and the player to the starting position
+void restartLevel(LevelMap &Level, Player &player, Point starting_pos, Camera &camera, DirtyRegions &dirty);
+
+// switches to level n as it was loaded and puts the player on its
+// starting position; the screen is swapped with the preloaded picture
+// of the level if there is one. returns level n, throws
+// std::runtime_error (and stays on the current level) if it can not be opened
+LevelMap &startLevel(LevelSet &levels, Player &player, int n, Image &screen, Camera &camera, DirtyRegions &dirty);
+
+#endif //MAIN_GAME_H
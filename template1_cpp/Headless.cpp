@@ -0,0 +1,657 @@
+// runs the game without a window: same LevelMap, Player and Image code
+// drawing into the in-memory screen, driven by a scripted input,
+// and reports timings for the renderer
+//
+// usage (from bin/, like the game itself):
+//   headless [--frames N] [--script STEPS] [--level N]
+//            [--dump DIR] [--dump-every N]
+//            [--record FILE] [--replay FILE] [--map FILE]
+//            [--chunks N] [--load-bench N]
+//            [--save FILE] [--load FILE] [--threads N] [--scaling]
+//            [--pipeline N]
+//   headless --selftest [NAME]
+//
+// STEPS is a comma separated list of keys followed by a number of
+// frames to hold them, keys are w a s d, b (break a wall),
+// r (go back in time) and - (nothing),
+// e.g. "d40,w40,sd10,b1,-20"; the script is repeated until the end
+//
+// --record writes the input of every frame to an input log, --replay
+// plays one back instead of the script (for as many frames as were
+// recorded, unless --frames is given) and checks the recorded state
+// hashes, so a run is reproduced bit for bit or the first differing
+// tick is reported
+//
+// --map replaces the starting level with the given map file (text or
+// world), --chunks sets how many chunks of a world file are kept in use;
+// levels are converted to world files with levelconv
+//
+// --load FILE starts from a saved game instead of the level, --save
+// saves the game at the end and reports how long capturing, writing
+// and reading the save take
+//
+// --threads N draws and decodes on N threads (default: one per core),
+// --scaling also times full redraws on 1, 2, 4 and 8 threads
+//
+// --pipeline N hands the frames to a presenting thread with N frames
+// in flight, the way the game does; the presented picture is checked
+// against the screen at the end, and a change of the scripted keys is
+// timed like a key press until the frame showing it is presented
+//
+// --load-bench N generates an N x N tile map, times reading it as text
+// and opening it as a world file, and exits
+//
+// --selftest runs the checks of SelfTest.cpp (or only the one named),
+// the exit code is 1 if any of them fails
+
+#include "Allocations.h"
+#include "Image.h"
+#include "Player.h"
+#include "Blend.h"
+#include "TileAtlas.h"
+#include "DirtyRegions.h"
+#include "Stats.h"
+#include "Game.h"
+#include "InputRecorder.h"
+#include "Rewind.h"
+#include "FramePipeline.h"
+#include "SaveGame.h"
+#include "SelfTest.h"
+#include "stb_image_write.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct ScriptStep
+{
+  Controls controls;
+  int frames;
+};
+
+static std::vector<ScriptStep> parseScript(const std::string &text)
+{
+  std::vector<ScriptStep> steps;
+  size_t pos = 0;
+
+  while (pos < text.size())
+  {
+    size_t end = text.find(',', pos);
+    if (end == std::string::npos)
+      end = text.size();
+
+    ScriptStep step{Controls(), 0};
+    size_t i = pos;
+    for (; i < end && !isdigit((unsigned char) text[i]); ++i)
+    {
+      switch (text[i])
+      {
+        case 'w': step.controls.up    = true; break;
+        case 's': step.controls.down  = true; break;
+        case 'a': step.controls.left  = true; break;
+        case 'd': step.controls.right = true; break;
+        case 'b': step.controls.smash = true; break;
+        case 'r': step.controls.rewind = true; break;
+        case '-': break;
+        default:
+          throw std::runtime_error("Unknown key in script: " + text.substr(pos, end - pos));
+      }
+    }
+    step.frames = i < end ? atoi(text.c_str() + i) : 1;
+
+    if (step.frames > 0)
+      steps.push_back(step);
+    pos = end + 1;
+  }
+
+  if (steps.empty())
+    throw std::runtime_error("Empty script");
+
+  return steps;
+}
+
+static double cpuSeconds()
+{
+  return double(std::clock()) / CLOCKS_PER_SEC;
+}
+
+static double wallSeconds()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template <typename F>
+static double measureSeconds(F f)
+{
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static int loadBenchmark(int size)
+{
+  if (size < 3 || size > MAX_MAP_TILES)
+  {
+    std::cout << "map size must be between 3 and " << MAX_MAP_TILES << std::endl;
+    return 1;
+  }
+
+  const std::string text_path = "load_bench.txt", world_path = "load_bench.lvl";
+  const int runs = 5;
+  double tiles = double(size) * size;
+
+  try {
+    std::string text = generateMap(size, size);
+    FILE *f = fopen(text_path.c_str(), "wb");
+    if (f == nullptr)
+      throw std::runtime_error("Unable to write " + text_path);
+    fwrite(text.data(), 1, text.size(), f);
+    fclose(f);
+
+    // the best of a few runs, once the file is in the page cache
+    double text_seconds = 1e9;
+    Point starting_pos;
+    for (int i = 0; i < runs; ++i)
+    {
+      LevelMap Level;
+      text_seconds = std::min(text_seconds, measureSeconds([&]() {
+        starting_pos = Level.read(text_path);
+      }));
+      if (i == 0)
+        Level.write(world_path, starting_pos);
+    }
+
+    // a world file is read lazily, so every chunk is touched
+    double world_seconds = 1e9;
+    for (int i = 0; i < runs; ++i)
+    {
+      LevelMap Level;
+      Level.setChunkBudget(INT32_MAX);
+      world_seconds = std::min(world_seconds, measureSeconds([&]() {
+        Level.read(world_path);
+        for (int y = 0; y < Level.height(); y += CHUNK_TILES)
+          for (int x = 0; x < Level.width(); x += CHUNK_TILES)
+            Level.get(x, y);
+      }));
+    }
+
+    std::cout << "map: " << size << "x" << size << " tiles, " << text.size() / 1024 << " KB of text" << std::endl;
+    std::cout << "text read: " << text_seconds * 1e3 << " ms, " << text_seconds / tiles * 1e9 << " ns per tile, "
+              << text.size() / text_seconds / (1 << 20) << " MB/s" << std::endl;
+    std::cout << "world open: " << world_seconds * 1e3 << " ms, " << world_seconds / tiles * 1e9
+              << " ns per tile" << std::endl;
+  } catch (std::runtime_error &exc) {
+    std::cout << exc.what() << std::endl;
+    std::remove(text_path.c_str());
+    std::remove(world_path.c_str());
+    return 1;
+  }
+
+  std::remove(text_path.c_str());
+  std::remove(world_path.c_str());
+  return 0;
+}
+
+struct Options
+{
+  int frames = -1;
+  int dump_every = 0;
+  int level = 1;
+  std::string script = "d40,w40,b1,a40,s40,wd20,-10";
+  std::string dump_dir;
+  std::string record_path, replay_path;
+  std::string map_path;
+  std::string save_path, load_path;
+  int threads = 0;
+  bool scaling = false;
+  int pipeline_depth = 0;
+  int chunk_budget = 0;
+  int load_bench = -1;  // map size, runs the load benchmark instead
+  bool selftest = false;
+  std::string selftest_name;  // all checks when empty
+};
+
+// false on an unknown option or a missing value
+static bool parseOptions(int argc, char** argv, Options &opts)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    bool has_value = i + 1 < argc;
+
+    if (!strcmp(argv[i], "--frames") && has_value)
+      opts.frames = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--script") && has_value)
+      opts.script = argv[++i];
+    else if (!strcmp(argv[i], "--level") && has_value)
+      opts.level = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--dump") && has_value)
+      opts.dump_dir = argv[++i];
+    else if (!strcmp(argv[i], "--dump-every") && has_value)
+      opts.dump_every = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--record") && has_value)
+      opts.record_path = argv[++i];
+    else if (!strcmp(argv[i], "--replay") && has_value)
+      opts.replay_path = argv[++i];
+    else if (!strcmp(argv[i], "--map") && has_value)
+      opts.map_path = argv[++i];
+    else if (!strcmp(argv[i], "--chunks") && has_value)
+      opts.chunk_budget = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--save") && has_value)
+      opts.save_path = argv[++i];
+    else if (!strcmp(argv[i], "--load") && has_value)
+      opts.load_path = argv[++i];
+    else if (!strcmp(argv[i], "--threads") && has_value)
+      opts.threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--scaling"))
+      opts.scaling = true;
+    else if (!strcmp(argv[i], "--pipeline") && has_value)
+      opts.pipeline_depth = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--load-bench") && has_value)
+      opts.load_bench = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--selftest"))
+    {
+      opts.selftest = true;
+      if (has_value && strncmp(argv[i + 1], "--", 2) != 0)
+        opts.selftest_name = argv[++i];
+    }
+    else
+      return false;
+  }
+
+  if (!opts.dump_dir.empty() && opts.dump_every <= 0)
+    opts.dump_every = 1;
+  return true;
+}
+
+// captures, writes and reads back a save of the game
+static bool saveBenchmark(const std::string &path, int curLevel, const LevelMap &Level, const Player &player)
+{
+  try {
+    SaveState saved;
+    double capture_seconds = measureSeconds([&]() {
+      saved = captureGame(curLevel, Level, player);
+    });
+    double write_seconds = measureSeconds([&]() {
+      writeSave(path, saved);
+    });
+    SaveState loaded;
+    double read_seconds = measureSeconds([&]() {
+      loaded = readSave(path);
+    });
+    std::cout << "save: " << saved.tiles.size() << " changed tiles, captured in " << capture_seconds * 1e6
+              << " us, written in " << write_seconds * 1e6 << " us, read in " << read_seconds * 1e6
+              << " us" << std::endl;
+  } catch (std::runtime_error &exc) {
+    std::cout << exc.what() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// collision checks, rewind recording and full redraws of the level as
+// it was left; returns the seconds a full redraw takes
+static double kernelBenchmarks(LevelMap &Level, const Player &player, Image &screen, const TileAtlas &tiles)
+{
+  // movement checks in every direction from every pixel position
+  long collision_checks = 0, passable = 0;
+  double collision_seconds = measureSeconds([&]() {
+    for (int y = 0; y < std::min(Level.height() * tileSize, WINDOW_HEIGHT) - tileSize; y += 3) {
+      for (int x = 0; x < std::min(Level.width() * tileSize, WINDOW_WIDTH) - tileSize; x += 3) {
+        passable += mayGo(x, y, MovementDir::UP, Level) + mayGo(x, y, MovementDir::DOWN, Level) +
+                    mayGo(x, y, MovementDir::LEFT, Level) + mayGo(x, y, MovementDir::RIGHT, Level);
+        collision_checks += 4;
+      }
+    }
+  });
+
+  // what keeping the history costs a tick, keyframes included
+  Rewind history;
+  history.reset(Level, player);
+  const int recorded_ticks = 100000;
+  double record_seconds = measureSeconds([&]() {
+    for (int i = 0; i < recorded_ticks; ++i) {
+      history.record(Level, player);
+    }
+  });
+
+  // full redraws, to see what a single tile costs
+  const int redraws = 200;
+  double redraw_seconds = measureSeconds([&]() {
+    for (int i = 0; i < redraws; ++i) {
+      Level.draw(screen, tiles);
+    }
+  }) / redraws;
+
+  std::cout << "collision check: " << collision_seconds / collision_checks * 1e9 << " ns ("
+            << passable << " of " << collision_checks << " passable)" << std::endl;
+  std::cout << "rewind record: " << record_seconds / recorded_ticks * 1e9 << " ns per tick" << std::endl;
+  std::cout << "full redraw: " << redraw_seconds * 1e6 << " us" << std::endl;
+  int visible_tiles = std::min(Level.width(), X_TILES) * std::min(Level.height(), Y_TILES);
+  std::cout << "tile blit: " << redraw_seconds / visible_tiles * 1e9 << " ns" << std::endl;
+  return redraw_seconds;
+}
+
+// the same full redraw, split into bands on 1, 2, 4 and 8 threads
+static void scalingBenchmark(LevelMap &Level, Image &screen, const TileAtlas &tiles, double redraw_seconds)
+{
+  const int redraws = 200;
+  for (int n : {1, 2, 4, 8}) {
+    JobSystem pool(n);
+    Level.draw(screen, tiles, &pool);
+    double seconds = measureSeconds([&]() {
+      for (int i = 0; i < redraws; ++i) {
+        Level.draw(screen, tiles, &pool);
+      }
+    }) / redraws;
+    std::cout << "full redraw on " << n << " threads: " << seconds * 1e6 << " us ("
+              << redraw_seconds / seconds << "x)" << std::endl;
+  }
+  std::cout << "cores: " << std::thread::hardware_concurrency() << std::endl;
+}
+
+// plays the script (or a replay) frame by frame and reports timings
+static int runGame(const Options &opts)
+{
+  int frames = opts.frames;
+  int curLevel = opts.level;
+  // row 0 of the screen is the bottom one
+  stbi_flip_vertically_on_write(1);
+
+  std::vector<ScriptStep> steps;
+  TileAtlas tiles;
+  Point starting_pos;
+  LevelSet levels(tiles, WINDOW_WIDTH, WINDOW_HEIGHT);
+  JobSystem jobs(opts.threads);
+  LevelMap *Level = nullptr;
+  std::unique_ptr<InputRecorder> recorder;
+  std::unique_ptr<InputReplay> replay;
+
+  try {
+    steps = parseScript(opts.script);
+    if (!opts.replay_path.empty()) {
+      replay.reset(new InputReplay(opts.replay_path));
+      curLevel = replay->level();
+      if (frames < 0)
+        frames = int(replay->ticks());
+    }
+    if (!opts.record_path.empty()) {
+      recorder.reset(new InputRecorder(opts.record_path, curLevel));
+    }
+    loadTiles(tiles, &jobs);
+    if (opts.chunk_budget > 0)
+      levels.setChunkBudget(opts.chunk_budget);
+
+    double open_seconds = measureSeconds([&]() {
+      Level = &levels.open(curLevel, opts.map_path);
+    });
+    std::cout << "map opened in " << open_seconds * 1e3 << " ms" << std::endl;
+    starting_pos = levels.start();
+  } catch (std::runtime_error &exc) {
+    std::cout << exc.what() << std::endl;
+    return 1;
+  }
+
+  if (frames < 0)
+    frames = 2000;
+
+  Image screen(WINDOW_WIDTH, WINDOW_HEIGHT, 4);
+  DirtyRegions dirty(WINDOW_WIDTH, WINDOW_HEIGHT);
+  Camera camera(WINDOW_WIDTH, WINDOW_HEIGHT);
+  FrameStats stats;
+  StageStats stages;
+
+  // stands for the texture of the game, gets the changed pixels
+  Image shown(WINDOW_WIDTH, WINDOW_HEIGHT, 4);
+  std::unique_ptr<FramePipeline> pipeline;
+  bool whole_frame = true;
+  if (opts.pipeline_depth > 0) {
+    pipeline.reset(new FramePipeline(WINDOW_WIDTH, WINDOW_HEIGHT, opts.pipeline_depth,
+      [&shown](const Image &frame, const std::vector<Rect> &changed) {
+        size_t bytes = 0;
+        for (const Rect &r : changed) {
+          for (int y = r.y; y < r.y + r.h; ++y) {
+            size_t offset = size_t(y) * frame.Width() + r.x;
+            memcpy(shown.Data() + offset, frame.Data() + offset, r.w * sizeof(Pixel));
+          }
+          bytes += size_t(r.w) * r.h * sizeof(Pixel);
+        }
+        return bytes;
+      }));
+  }
+
+  Image left("../resources/tiles/floor.png");
+  Image right("../resources/tiles/floor.png");
+
+  Image("../resources/tiles/knight_left.png").Draw(left);
+  Image("../resources/tiles/knight_right.png").Draw(right);
+
+  // sprites are moved into the player, so this allocates nothing
+  long allocations_before_player = allocationCount();
+  Player player(starting_pos, std::move(left), std::move(right));
+  long player_allocations = allocationCount() - allocations_before_player;
+
+  levels.track(dirty, camera);
+  showLevel(*Level, player, camera);
+  dirty.addAll();
+
+  if (!opts.load_path.empty()) {
+    try {
+      double load_seconds = measureSeconds([&]() {
+        Level = &applySave(readSave(opts.load_path), levels, player, camera, dirty);
+      });
+      curLevel = levels.number();
+      starting_pos = levels.start();
+      std::cout << "save loaded in " << load_seconds * 1e3 << " ms" << std::endl;
+    } catch (std::runtime_error &exc) {
+      std::cout << exc.what() << std::endl;
+      return 1;
+    }
+  }
+
+  size_t step = 0;
+  int step_frame = 0;
+  long frame_allocations = 0, max_frame_allocations = 0;
+  int scrolled_frames = 0;
+  int level_switches = 0;
+  double max_switch_seconds = 0;
+  int restarts = 0;
+  Rewind rewind;
+  rewind.reset(*Level, player);
+  long rewound_ticks = 0;
+  double max_restart_seconds = 0;
+
+  double cpu_last = cpuSeconds(), wall_last = wallSeconds();
+  Controls last_controls;
+  std::vector<double> inputs;
+
+  double seconds = measureSeconds([&]() {
+    for (int frame = 0; frame < frames; ++frame) {
+      double simulate_start = wallSeconds();
+      long allocations_before = allocationCount();
+
+      Controls controls = steps[step].controls;
+      if (++step_frame == steps[step].frames) {
+        step = (step + 1) % steps.size();
+        step_frame = 0;
+      }
+
+      if (replay) {
+        controls = replay->next();
+      }
+      if (recorder) {
+        recorder->tick(controls);
+      }
+      if (memcmp(&controls, &last_controls, sizeof(controls)) != 0) {
+        inputs.push_back(simulate_start);
+      }
+      last_controls = controls;
+
+      if (controls.rewind) {
+        rewound_ticks += rewind.back(REWIND_SPEED, *Level, player, camera, dirty);
+      } else {
+        simulateTick(player, *Level, controls);
+        rewind.record(*Level, player);
+      }
+
+      if (player.status == playerStatus::ESCAPED) {
+        // the next level is ready unless it was finished very quickly
+        double switch_seconds = measureSeconds([&]() {
+          try {
+            Level = &startLevel(levels, player, curLevel % N_LEVELS + 1, screen, camera, dirty);
+            whole_frame = true;
+            curLevel = levels.number();
+            starting_pos = levels.start();
+          } catch (std::runtime_error &exc) {
+            std::cout << exc.what() << std::endl;
+            restartLevel(*Level, player, starting_pos, camera, dirty);
+          }
+          rewind.reset(*Level, player);
+        });
+        level_switches++;
+        max_switch_seconds = std::max(max_switch_seconds, switch_seconds);
+      }
+
+      if (player.status == playerStatus::DEAD) {
+        restarts++;
+        max_restart_seconds = std::max(max_restart_seconds, measureSeconds([&]() {
+          restartLevel(*Level, player, starting_pos, camera, dirty);
+        }));
+        rewind.reset(*Level, player);
+      }
+
+      if ((frame + 1) % HASH_INTERVAL == 0 && (recorder || replay)) {
+        uint64_t hash = stateHash(*Level, player);
+        if (recorder) {
+          recorder->checkpoint(hash);
+        }
+        if (replay) {
+          replay->verify(hash);
+        }
+      }
+
+      std::string preload_error = levels.preloadError();
+      if (!preload_error.empty()) {
+        std::cout << preload_error << std::endl;
+      }
+      std::string chunk_error = Level->error();
+      if (!chunk_error.empty()) {
+        std::cout << chunk_error << std::endl;
+      }
+
+      // one frame per tick, drawn where the tick left the player
+      double rasterize_start = wallSeconds();
+      stages.add(StageStats::SIMULATE, rasterize_start - simulate_start);
+      placePlayer(player, 1.0, camera, dirty);
+      if (camera.scroll(screen, dirty)) {
+        scrolled_frames++;
+        whole_frame = true;
+      }
+      Level->stream(camera.shown());
+      const std::vector<Rect> &changed = repaint(screen, *Level, tiles, player, camera, dirty, &jobs);
+      stages.add(StageStats::RASTERIZE, wallSeconds() - rasterize_start);
+
+      if (pipeline && whole_frame) {
+        pipeline->submitAll(screen, inputs);
+      } else if (pipeline && !changed.empty()) {
+        pipeline->submit(screen, changed, inputs);
+      }
+      whole_frame = false;
+      inputs.clear();
+
+      double cpu_now = cpuSeconds(), wall_now = wallSeconds();
+      stats.frame(dirty.pixels(), pipeline ? pipeline->lastUploadBytes() : 0, cpu_now - cpu_last, wall_now - wall_last);
+      cpu_last = cpu_now;
+      wall_last = wall_now;
+
+      long used = allocationCount() - allocations_before;
+      frame_allocations += used;
+      if (used > max_frame_allocations)
+        max_frame_allocations = used;
+
+      if (opts.dump_every > 0 && frame % opts.dump_every == 0) {
+        char name[32];
+        snprintf(name, sizeof(name), "/frame_%06d.png", frame);
+        screen.Save(opts.dump_dir + name);
+      }
+    }
+  });
+
+  // tells apart runs that rendered something different
+  uint64_t last_frame_hash = frameHash(screen);
+  if (pipeline) {
+    pipeline->finish();
+    stages.merge(pipeline->stages());
+  }
+
+
+  if (!opts.save_path.empty() && !saveBenchmark(opts.save_path, curLevel, *Level, player))
+    return 1;
+
+  std::cout << "blending: " << BlendBackend() << std::endl;
+  std::cout << "last frame hash: " << std::hex << last_frame_hash << std::dec << std::endl;
+  stats.print(std::cout);
+  stages.print(std::cout);
+  if (pipeline) {
+    std::cout << "pipeline: " << pipeline->depth() << " frames in flight, presented frame "
+              << (frameHash(shown) == last_frame_hash ? "matches" : "differs from") << " the screen" << std::endl;
+    pipeline->inputLatency().print(std::cout);
+  }
+  if (frames > 0) {
+    std::cout << "frames per second: " << frames / seconds << std::endl;
+    std::cout << "map: " << Level->width() << "x" << Level->height() << " tiles, scrolled in "
+              << scrolled_frames << " frames" << std::endl;
+    std::cout << "level switches: " << level_switches << ", longest " << max_switch_seconds * 1e3 << " ms" << std::endl;
+    std::cout << "restarts: " << restarts << ", longest " << max_restart_seconds * 1e6 << " us" << std::endl;
+    std::cout << "rewind: " << rewound_ticks << " ticks undone, " << rewind.available() << " ticks kept, "
+              << rewind.memoryBytes() / 1024 << " KB" << std::endl;
+    const ChunkStats &chunks = Level->chunkStats();
+    std::cout << "chunks: " << chunks.hits << " hits, " << chunks.misses << " misses, "
+              << chunks.evictions << " evictions, " << chunks.resident << " resident ("
+              << chunks.resident_bytes / 1024 << " KB)" << std::endl;
+    std::cout << "allocations per frame: avg " << double(frame_allocations) / frames
+              << ", max " << max_frame_allocations << std::endl;
+  }
+  std::cout << "allocations creating player: " << player_allocations << std::endl;
+
+  double redraw_seconds = kernelBenchmarks(*Level, player, screen, tiles);
+  if (opts.scaling) {
+    scalingBenchmark(*Level, screen, tiles, redraw_seconds);
+  }
+
+  if (replay) {
+    std::cout << "replay: " << replay->checked() << " state hashes checked";
+    if (replay->firstMismatch() >= 0) {
+      std::cout << ", first mismatch after tick " << replay->firstMismatch() << std::endl;
+      return 2;
+    }
+    std::cout << ", all match" << std::endl;
+  }
+
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  Options opts;
+  if (!parseOptions(argc, argv, opts))
+  {
+    std::cout << "usage: " << argv[0] << " [--frames N] [--script STEPS] [--level N] [--dump DIR] [--dump-every N]"
+              << " [--record FILE] [--replay FILE] [--map FILE] [--chunks N] [--load-bench N]"
+              << " [--save FILE] [--load FILE] [--threads N] [--scaling] [--pipeline N] [--selftest [NAME]]" << std::endl;
+    return 1;
+  }
+
+  if (opts.selftest)
+    return runSelfTests(opts.selftest_name);
+  if (opts.load_bench != -1)
+    return loadBenchmark(opts.load_bench);
+  return runGame(opts);
+}
@@ -1,50 +1,92 @@
 #include "Image.h"
+#include "Blend.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
+#include <algorithm>
 #include <iostream>
 
 
-Image::Image(const std::string &a_path)
+void PixelDeleter::operator()(Pixel *p) const
 {
-  if((data = (Pixel*)stbi_load(a_path.c_str(), &width, &height, &channels, sizeof(Pixel))) != nullptr)
+  if(from_stb)
+    stbi_image_free(p);
+  else
+    delete [] p;
+}
+
+Image::Image(const std::string &a_path) : Image(a_path.c_str())
+{
+}
+
+Image::Image(const char *a_path)
+{
+  Pixel *loaded = (Pixel*)stbi_load(a_path, &width, &height, &channels, sizeof(Pixel));
+  if(loaded != nullptr)
   {
+    data = PixelBuffer(loaded, PixelDeleter{true});
     size = width * height * channels;
     //std::cout << width << " " << height << " " << channels << std::endl;
   }
   
 }
 
-Image::Image(int a_width, int a_height, int a_channels)
+Image::Image(int a_width, int a_height, int a_channels) :
+  data(new Pixel[a_width * a_height]{}, PixelDeleter{false})
 {
-  data = new Pixel[a_width * a_height ]{};
+  width = a_width;
+  height = a_height;
+  size = a_width * a_height * a_channels;
+  channels = a_channels;
+}
+
+Image::Image(Image &&im) noexcept :
+  x(im.x), y(im.y), width(im.width), height(im.height),
+  channels(im.channels), size(im.size), data(std::move(im.data))
+{
+  im.width = -1;
+  im.height = -1;
+  im.size = 0;
+}
 
-  if(data != nullptr)
+Image& Image::operator=(Image &&im) noexcept
+{
+  if(this != &im)
   {
-    width = a_width;
-    height = a_height;
-    size = a_width * a_height * a_channels;
-    channels = a_channels;
-    self_allocated = true;
+    x = im.x;
+    y = im.y;
+    width = im.width;
+    height = im.height;
+    channels = im.channels;
+    size = im.size;
+    data = std::move(im.data);
+
+    im.width = -1;
+    im.height = -1;
+    im.size = 0;
   }
+  return *this;
 }
 
-Image& Image::operator=(const Image &im) {
-  x = im.x;
-  y = im.y;
-  width = im.width;
-  height = im.height;
-  channels = im.channels;
-  size = im.size;
-  self_allocated = im.self_allocated;
-
-  data = new Pixel[size];
-  for (int i = 0; i < size; ++i) {
-    data[i] = im.data[i];
+Image Image::clone() const
+{
+  Image copy;
+  copy.x = x;
+  copy.y = y;
+  copy.width = width;
+  copy.height = height;
+  copy.channels = channels;
+  copy.size = size;
+
+  if(data)
+  {
+    copy.data = PixelBuffer(new Pixel[width * height], PixelDeleter{false});
+    std::copy(data.get(), data.get() + width * height, copy.data.get());
   }
+  return copy;
 }
 
 
@@ -53,12 +95,12 @@ int Image::Save(const std::string &a_path)
   auto extPos = a_path.find_last_of('.');
   if(a_path.substr(extPos, std::string::npos) == ".png" || a_path.substr(extPos, std::string::npos) == ".PNG")
   {
-    stbi_write_png(a_path.c_str(), width, height, channels, data, width * channels);
+    stbi_write_png(a_path.c_str(), width, height, channels, data.get(), width * channels);
   }
   else if(a_path.substr(extPos, std::string::npos) == ".jpg" || a_path.substr(extPos, std::string::npos) == ".JPG" ||
           a_path.substr(extPos, std::string::npos) == ".jpeg" || a_path.substr(extPos, std::string::npos) == ".JPEG")
   {
-    stbi_write_jpg(a_path.c_str(), width, height, channels, data, 100);
+    stbi_write_jpg(a_path.c_str(), width, height, channels, data.get(), 100);
   }
   else
   {
@@ -71,23 +113,34 @@ int Image::Save(const std::string &a_path)
 
 void Image::Draw(Image &screen)
 {
+  Blit(screen, Rect{0, 0, width, height}, x, y);
+}
 
-  for(int yOnPic = 0; yOnPic < height; ++yOnPic)
-  {
-    for(int xOnPic = 0; xOnPic < width; ++xOnPic)
-    {
-      Pixel newPixel = mix(screen.Data()[x + xOnPic + (y + yOnPic) * screen.Width()], data[xOnPic + yOnPic * width]);
-      screen.PutPixel(x + xOnPic, y + yOnPic, newPixel);
-    }
-  }
+void Image::Blit(Image &screen, Rect src, int dstX, int dstY) const
+{
+  Blit(screen, src, dstX, dstY, Rect{0, 0, screen.Width(), screen.Height()});
 }
 
-Image::~Image()
+void Image::Blit(Image &screen, Rect src, int dstX, int dstY, Rect clip) const
 {
-  if(self_allocated)
-    delete [] data;
-  else
+  // everything is intersected in screen coordinates:
+  // the requested rectangle, the whole image placed so that src lands
+  // at (dstX, dstY), the clip rectangle and the screen itself
+  Rect visible = Rect{dstX, dstY, src.w, src.h};
+  visible = Intersect(visible, Rect{dstX - src.x, dstY - src.y, width, height});
+  visible = Intersect(visible, clip);
+  visible = Intersect(visible, Rect{0, 0, screen.Width(), screen.Height()});
+
+  if(visible.Empty())
+    return;
+
+  const Pixel *from = data.get() + (visible.x - dstX + src.x) + (visible.y - dstY + src.y) * width;
+  Pixel *to = screen.Data() + visible.x + visible.y * screen.Width();
+
+  for(int row = 0; row < visible.h; ++row)
   {
-    stbi_image_free(data);
+    BlendRow(to, from, visible.w);
+    from += width;
+    to += screen.Width();
   }
-}
\ No newline at end of file
+}
@@ -1,6 +1,7 @@
 #ifndef MAIN_IMAGE_H
 #define MAIN_IMAGE_H
 
+#include <memory>
 #include <string>
 
 constexpr int tileSize = 16;
@@ -13,7 +14,7 @@ struct Pixel
   uint8_t a;
 };
 
-static Pixel mix(Pixel &oldPixel, Pixel newPixel) {
+inline Pixel mix(Pixel &oldPixel, Pixel newPixel) {
   newPixel.r = newPixel.a / 255.0 * (newPixel.r - oldPixel.r) + oldPixel.r;
   newPixel.g = newPixel.a / 255.0 * (newPixel.g - oldPixel.g) + oldPixel.g;
   newPixel.b = newPixel.a / 255.0 * (newPixel.b - oldPixel.b) + oldPixel.b;
@@ -24,32 +25,74 @@ static Pixel mix(Pixel &oldPixel, Pixel newPixel) {
 
 constexpr Pixel backgroundColor{0, 0, 0, 0};
 
+struct Rect
+{
+  int x;
+  int y;
+  int w;
+  int h;
+
+  bool Empty() const { return w <= 0 || h <= 0; }
+};
+
+inline Rect Intersect(const Rect &a, const Rect &b) {
+  int x0 = a.x > b.x ? a.x : b.x;
+  int y0 = a.y > b.y ? a.y : b.y;
+  int x1 = a.x + a.w < b.x + b.w ? a.x + a.w : b.x + b.w;
+  int y1 = a.y + a.h < b.y + b.h ? a.y + a.h : b.y + b.h;
+
+  return Rect{x0, y0, x1 - x0, y1 - y0};
+}
+
+// frees pixels the way they were allocated:
+// stbi_image_free for loaded files, delete[] for the rest
+struct PixelDeleter
+{
+  bool from_stb = false;
+  void operator()(Pixel *p) const;
+};
+
+typedef std::unique_ptr<Pixel[], PixelDeleter> PixelBuffer;
+
+// owns its pixels; can be moved, but copies have to be asked for with clone()
 struct Image
 {
   Image (){};
-  Image& operator=(const Image &im);
+  explicit Image(const char *a_path);
   explicit Image(const std::string &a_path);
   Image(int a_width, int a_height, int a_channels);
 
-  //Image(const Image &im) = delete;
+  Image(const Image &im) = delete;
+  Image& operator=(const Image &im) = delete;
+
+  Image(Image &&im) noexcept;
+  Image& operator=(Image &&im) noexcept;
+
+  // deep copy
+  Image clone() const;
 
   int Save(const std::string &a_path);
   void Draw(Image &screen);
 
-  int set_x(int xx) { x = xx;  }
-  int set_y(int yy) { y = yy;  }
+  // draws the src part of the image with its corner at (dstX, dstY),
+  // touching only screen pixels inside clip; the visible part is
+  // computed once, so it is safe to draw sprites partly off-screen
+  void Blit(Image &screen, Rect src, int dstX, int dstY, Rect clip) const;
+  void Blit(Image &screen, Rect src, int dstX, int dstY) const;
+
+  void set_x(int xx) { x = xx;  }
+  void set_y(int yy) { y = yy;  }
 
   int Width()    const { return width; }
   int Height()   const { return height; }
   int Channels() const { return channels; }
   size_t Size()  const { return size; }
-  Pixel* Data()        { return  data; }
+  Pixel* Data()        { return  data.get(); }
+  const Pixel* Data() const { return data.get(); }
 
   Pixel GetPixel(int x, int y) { return data[width * y + x];}
   void  PutPixel(int x, int y, const Pixel &pix) { data[width* y + x] = pix; }
 
-  ~Image();
-
 private:
   int x = 0;
   int y = 0;
@@ -57,10 +100,8 @@ private:
   int height = -1;
   int channels = 3;
   size_t size = 0;
-  Pixel *data = nullptr;
-  bool self_allocated = false;
+  PixelBuffer data;
 };
 
 
-
 #endif //MAIN_IMAGE_H
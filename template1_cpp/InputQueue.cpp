@@ -0,0 +1,32 @@
+#include "InputQueue.h"
+
+#include <cstring>
+
+constexpr int InputQueue::MAX_KEYS;
+constexpr size_t InputQueue::CAPACITY;
+
+void InputQueue::push(int key, bool pressed, double time)
+{
+  if (key < 0 || key >= MAX_KEYS)
+    return;
+
+  if (!events.push(KeyEvent{time, key, pressed}))
+    n_dropped++;
+}
+
+void InputQueue::advance(double until, std::vector<double> *applied)
+{
+  memset(tapped, 0, sizeof(tapped));
+
+  // events after the end of the tick wait for the next one
+  const KeyEvent *e;
+  while ((e = events.front()) != nullptr && e->time <= until)
+  {
+    if (e->pressed)
+      tapped[e->key] = true;
+    down[e->key] = e->pressed;
+    if (applied != nullptr)
+      applied->push_back(e->time);
+    events.pop();
+  }
+}
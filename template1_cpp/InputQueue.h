@@ -0,0 +1,97 @@
+#ifndef MAIN_INPUTQUEUE_H
+#define MAIN_INPUTQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// bounded queue for one producer and one consumer thread, without
+// locks: the producer only moves the tail, the consumer the head
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+  static_assert((Capacity & (Capacity - 1)) == 0, "capacity has to be a power of two");
+
+public:
+  // producer; false if the queue is full
+  bool push(const T &item)
+  {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == Capacity)
+      return false;
+
+    items[t & (Capacity - 1)] = item;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer; the oldest item, nullptr if there is none
+  const T *front() const
+  {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire))
+      return nullptr;
+    return &items[h & (Capacity - 1)];
+  }
+
+  // consumer; drops the item front() returned
+  void pop()
+  {
+    head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+private:
+  // on cache lines of their own, the two threads do not share one
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+  T items[Capacity];
+};
+
+// a key going down or up, time in seconds on the game clock
+struct KeyEvent
+{
+  double time;
+  int key;
+  bool pressed;
+};
+
+// key events from the window in the order they came, handed to the
+// simulation tick by tick: a tick sees the events up to its end, so a
+// key is never read between two events, and a press shorter than a
+// tick still counts for the tick it happened in
+//
+// for now both ends run on the main thread: GLFW calls the key callback
+// from glfwPollEvents(), before the ticks of the frame. the queue is
+// kept SPSC so events can come from a thread of their own later
+class InputQueue
+{
+public:
+  static constexpr int MAX_KEYS = 1024;
+  static constexpr size_t CAPACITY = 256;
+
+  // producer, the window's key callback
+  void push(int key, bool pressed, double time);
+
+  // consumer, before a tick that ends at until; the times of the
+  // events applied are added to applied
+  void advance(double until, std::vector<double> *applied = nullptr);
+
+  // the key was down during the tick
+  bool held(int key) const
+  {
+    return key >= 0 && key < MAX_KEYS && (down[key] || tapped[key]);
+  }
+
+  // events lost because the queue was full
+  long dropped() const { return n_dropped; }
+
+private:
+  SpscQueue<KeyEvent, CAPACITY> events;
+  std::atomic<long> n_dropped{0};
+
+  // consumer state
+  bool down[MAX_KEYS] = {};
+  bool tapped[MAX_KEYS] = {};  // pressed during the tick
+};
+
+#endif //MAIN_INPUTQUEUE_H
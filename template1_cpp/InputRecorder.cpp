@@ -0,0 +1,259 @@
+#include "InputRecorder.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+static const char MAGIC[4] = {'E', 'C', 'I', 'R'};
+static const uint32_t VERSION = 2;
+
+// longest tick count of a run, and most ticks a replay may have
+// (over a year at 60 ticks a second)
+static const int MAX_VARINT_BYTES = 9;
+static const uint64_t MAX_REPLAY_TICKS = INT32_MAX;
+
+enum RecordKind : uint8_t
+{
+  INPUT = 0,
+  HASH  = 1
+};
+
+enum KeyBit : uint8_t
+{
+  KEY_UP    = 1 << 0,
+  KEY_DOWN  = 1 << 1,
+  KEY_LEFT  = 1 << 2,
+  KEY_RIGHT = 1 << 3,
+  KEY_SMASH = 1 << 4,
+  KEY_REWIND = 1 << 5
+};
+
+uint8_t packControls(const Controls &controls)
+{
+  return uint8_t((controls.up    ? KEY_UP    : 0) |
+                 (controls.down  ? KEY_DOWN  : 0) |
+                 (controls.left  ? KEY_LEFT  : 0) |
+                 (controls.right ? KEY_RIGHT : 0) |
+                 (controls.smash ? KEY_SMASH : 0) |
+                 (controls.rewind ? KEY_REWIND : 0));
+}
+
+Controls unpackControls(uint8_t mask)
+{
+  Controls controls;
+  controls.up    = (mask & KEY_UP)    != 0;
+  controls.down  = (mask & KEY_DOWN)  != 0;
+  controls.left  = (mask & KEY_LEFT)  != 0;
+  controls.right = (mask & KEY_RIGHT) != 0;
+  controls.smash = (mask & KEY_SMASH) != 0;
+  controls.rewind = (mask & KEY_REWIND) != 0;
+  return controls;
+}
+
+// FNV-1a, over 64-bit words where there are many of them
+static const uint64_t FNV_PRIME = 1099511628211ull;
+static const uint64_t FNV_OFFSET = 14695981039346656037ull;
+
+uint64_t stateHash(const LevelMap &Level, Player &player)
+{
+  uint64_t hash = FNV_OFFSET;
+
+  for (int y = 0; y < Level.height(); ++y)
+    for (int x = 0; x < Level.width(); ++x)
+      hash = (hash ^ uint8_t(Level.get(x, y))) * FNV_PRIME;
+
+  Point coords = player.getCoords();
+  hash = (hash ^ uint64_t(uint32_t(coords.x))) * FNV_PRIME;
+  hash = (hash ^ uint64_t(uint32_t(coords.y))) * FNV_PRIME;
+  hash = (hash ^ uint64_t(player.smash_cooldown)) * FNV_PRIME;
+  hash = (hash ^ uint64_t(player.status)) * FNV_PRIME;
+
+  return hash;
+}
+
+uint64_t frameHash(const Image &screen)
+{
+  uint64_t hash = FNV_OFFSET;
+
+  const Pixel *pixels = screen.Data();
+  size_t n = size_t(screen.Width()) * screen.Height();
+
+  for (size_t i = 0; i + 1 < n; i += 2)
+  {
+    uint64_t word = uint64_t(pixels[i].r)           | uint64_t(pixels[i].g) << 8  |
+                    uint64_t(pixels[i].b) << 16     | uint64_t(pixels[i].a) << 24 |
+                    uint64_t(pixels[i + 1].r) << 32 | uint64_t(pixels[i + 1].g) << 40 |
+                    uint64_t(pixels[i + 1].b) << 48 | uint64_t(pixels[i + 1].a) << 56;
+    hash = (hash ^ word) * FNV_PRIME;
+  }
+
+  return hash;
+}
+
+static void putU32(FILE *f, uint32_t v)
+{
+  uint8_t bytes[4] = {uint8_t(v), uint8_t(v >> 8), uint8_t(v >> 16), uint8_t(v >> 24)};
+  fwrite(bytes, 1, 4, f);
+}
+
+static void putU64(FILE *f, uint64_t v)
+{
+  putU32(f, uint32_t(v));
+  putU32(f, uint32_t(v >> 32));
+}
+
+static void putVarint(FILE *f, uint64_t v)
+{
+  while (v >= 0x80)
+  {
+    fputc(int(v & 0x7F) | 0x80, f);
+    v >>= 7;
+  }
+  fputc(int(v), f);
+}
+
+InputRecorder::InputRecorder(const std::string &path, int level)
+{
+  file = fopen(path.c_str(), "wb");
+  if (file == nullptr)
+    throw std::runtime_error("Unable to open file " + path);
+
+  fwrite(MAGIC, 1, sizeof(MAGIC), file);
+  putU32(file, VERSION);
+  putU32(file, uint32_t(level));
+}
+
+InputRecorder::~InputRecorder()
+{
+  flushRun();
+  fclose(file);
+}
+
+void InputRecorder::flushRun()
+{
+  if (run_length == 0)
+    return;
+
+  fputc(INPUT, file);
+  fputc(run_mask, file);
+  putVarint(file, run_length);
+  run_length = 0;
+}
+
+void InputRecorder::tick(const Controls &controls)
+{
+  uint8_t mask = packControls(controls);
+  if (mask != run_mask)
+  {
+    flushRun();
+    run_mask = mask;
+  }
+  run_length++;
+}
+
+void InputRecorder::checkpoint(uint64_t hash)
+{
+  flushRun();
+  fputc(HASH, file);
+  putU64(file, hash);
+}
+
+
+InputReplay::InputReplay(const std::string &path)
+{
+  FILE *f = fopen(path.c_str(), "rb");
+  if (f == nullptr)
+    throw std::runtime_error("Unable to open file " + path);
+
+  std::vector<uint8_t> data;
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+    data.insert(data.end(), buffer, buffer + n);
+  fclose(f);
+
+  size_t pos = 0;
+  auto need = [&](size_t bytes) {
+    if (pos + bytes > data.size())
+      throw std::runtime_error("Input log is truncated: " + path);
+  };
+  auto getU32 = [&]() {
+    need(4);
+    uint32_t v = uint32_t(data[pos]) | uint32_t(data[pos + 1]) << 8 |
+                 uint32_t(data[pos + 2]) << 16 | uint32_t(data[pos + 3]) << 24;
+    pos += 4;
+    return v;
+  };
+
+  need(sizeof(MAGIC));
+  if (!std::equal(MAGIC, MAGIC + sizeof(MAGIC), data.begin()))
+    throw std::runtime_error("Not an input log: " + path);
+  pos += sizeof(MAGIC);
+
+  if (getU32() != VERSION)
+    throw std::runtime_error("Unsupported input log version: " + path);
+  start_level = int(getU32());
+
+  while (pos < data.size())
+  {
+    uint8_t kind = data[pos++];
+    if (kind == INPUT)
+    {
+      need(1);
+      uint8_t mask = data[pos++];
+
+      // a broken log must not ask for more memory than there is
+      uint64_t count = 0;
+      for (int shift = 0; ; shift += 7)
+      {
+        if (shift == 7 * MAX_VARINT_BYTES)
+          throw std::runtime_error("Corrupted input log: " + path);
+        need(1);
+        uint8_t byte = data[pos++];
+        count |= uint64_t(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+          break;
+      }
+      if (count > MAX_REPLAY_TICKS - inputs.size())
+        throw std::runtime_error("Corrupted input log: " + path);
+      inputs.insert(inputs.end(), size_t(count), mask);
+    }
+    else if (kind == HASH)
+    {
+      uint64_t lo = getU32();
+      uint64_t hi = getU32();
+      hashes.emplace_back(inputs.size(), lo | hi << 32);
+    }
+    else
+    {
+      throw std::runtime_error("Corrupted input log: " + path);
+    }
+  }
+}
+
+Controls InputReplay::next()
+{
+  if (finished())
+  {
+    position++;
+    return Controls();
+  }
+  return unpackControls(inputs[position++]);
+}
+
+bool InputReplay::verify(uint64_t hash)
+{
+  while (next_hash < hashes.size() && hashes[next_hash].first < position)
+    next_hash++;
+
+  if (next_hash == hashes.size() || hashes[next_hash].first != position)
+    return true;
+
+  n_checked++;
+  if (hashes[next_hash++].second == hash)
+    return true;
+
+  if (first_mismatch < 0)
+    first_mismatch = long(position);
+  return false;
+}
@@ -0,0 +1,80 @@
+#ifndef MAIN_INPUTRECORDER_H
+#define MAIN_INPUTRECORDER_H
+
+#include "Game.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// input log file:
+//   "ECIR", version, starting level (little endian uint32 each)
+//   then records, each starting with a kind byte:
+//     INPUT: key mask byte, number of ticks it is held (varint)
+//     HASH:  state hash (uint64) taken after the ticks read so far
+//
+// hashes are written every HASH_INTERVAL ticks, so a replay can tell
+// where it went different from the recorded run
+
+constexpr int HASH_INTERVAL = 60;
+
+uint8_t packControls(const Controls &controls);
+Controls unpackControls(uint8_t mask);
+
+// hash of the simulation state after a tick: the map and the player
+uint64_t stateHash(const LevelMap &Level, Player &player);
+
+// hash of a rendered frame
+uint64_t frameHash(const Image &screen);
+
+class InputRecorder
+{
+public:
+  InputRecorder(const std::string &path, int level);
+  ~InputRecorder();
+
+  InputRecorder(const InputRecorder &) = delete;
+  InputRecorder& operator=(const InputRecorder &) = delete;
+
+  void tick(const Controls &controls);
+  void checkpoint(uint64_t hash);
+
+private:
+  void flushRun();
+
+  FILE *file = nullptr;
+  uint8_t run_mask = 0;
+  uint64_t run_length = 0;
+};
+
+class InputReplay
+{
+public:
+  explicit InputReplay(const std::string &path);
+
+  int level() const { return start_level; }
+  long ticks() const { return long(inputs.size()); }
+  bool finished() const { return position >= inputs.size(); }
+
+  // input for the next tick, nothing pressed after the end
+  Controls next();
+
+  // compares with the hash recorded after the current tick, if any;
+  // returns false on a mismatch
+  bool verify(uint64_t hash);
+
+  long checked() const { return n_checked; }
+  long firstMismatch() const { return first_mismatch; }
+
+private:
+  int start_level = 1;
+  std::vector<uint8_t> inputs;
+  std::vector<std::pair<uint64_t, uint64_t> > hashes; // tick, hash
+  size_t position = 0;
+  size_t next_hash = 0;
+  long n_checked = 0;
+  long first_mismatch = -1;
+};
+
+#endif //MAIN_INPUTRECORDER_H
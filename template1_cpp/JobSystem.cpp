@@ -0,0 +1,210 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+
+// the pool a thread works for and the queue it owns
+static thread_local const JobSystem *pool = nullptr;
+static thread_local int own_queue = -1;
+
+JobSystem::JobSystem(int threads) {
+  if (threads <= 0) {
+    threads = std::max(1, int(std::thread::hardware_concurrency()));
+  }
+
+  for (int i = 0; i < threads; ++i) {
+    queues.emplace_back(new Queue);
+  }
+  for (int i = 0; i + 1 < threads; ++i) {
+    workers.emplace_back([this, i]() { workerLoop(i); });
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> guard(sleep_lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (std::thread &t : workers) {
+    t.join();
+  }
+}
+
+JobSystem::Handle JobSystem::submit(std::function<void()> work, const std::vector<Handle> &after) {
+  Handle job = std::make_shared<Job>();
+  job->work = std::move(work);
+
+  for (const Handle &before : after) {
+    std::lock_guard<std::mutex> guard(before->lock);
+    if (!before->done) {
+      job->waiting++;
+      before->next.push_back(job);
+    }
+  }
+
+  // the jobs before it may all be finished already
+  if (--job->waiting == 0) {
+    push(job);
+  }
+  return job;
+}
+
+void JobSystem::push(Handle job) {
+  Queue &q = *queues[pool == this ? own_queue : int(workers.size())];
+  {
+    std::lock_guard<std::mutex> guard(q.lock);
+    q.jobs.push_back(std::move(job));
+  }
+  queued++;
+
+  {
+    std::lock_guard<std::mutex> guard(sleep_lock);
+  }
+  wake.notify_one();
+  // a waiting thread may help
+  finished.notify_all();
+}
+
+JobSystem::Handle JobSystem::take() {
+  if (queued == 0) {
+    return nullptr;
+  }
+
+  // the newest job of its own queue is the one most likely still in cache
+  int self = pool == this ? own_queue : int(workers.size());
+  {
+    Queue &q = *queues[self];
+    std::lock_guard<std::mutex> guard(q.lock);
+    if (!q.jobs.empty()) {
+      Handle job = std::move(q.jobs.back());
+      q.jobs.pop_back();
+      queued--;
+      return job;
+    }
+  }
+
+  // the oldest job of another queue, the victims taking turns
+  unsigned start = steal_from++;
+  for (size_t i = 0; i < queues.size(); ++i) {
+    size_t victim = (start + i) % queues.size();
+    if (int(victim) == self) {
+      continue;
+    }
+
+    Queue &q = *queues[victim];
+    std::lock_guard<std::mutex> guard(q.lock);
+    if (!q.jobs.empty()) {
+      Handle job = std::move(q.jobs.front());
+      q.jobs.pop_front();
+      queued--;
+      return job;
+    }
+  }
+  return nullptr;
+}
+
+void JobSystem::run(const Handle &job) {
+  try {
+    job->work();
+  } catch (...) {
+    job->error = std::current_exception();
+  }
+  job->work = nullptr;
+
+  std::vector<Handle> next;
+  {
+    std::lock_guard<std::mutex> guard(job->lock);
+    job->done = true;
+    next.swap(job->next);
+  }
+  for (const Handle &after : next) {
+    if (--after->waiting == 0) {
+      push(after);
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(sleep_lock);
+  }
+  finished.notify_all();
+}
+
+void JobSystem::wait(const Handle &job) {
+  while (!job->finished()) {
+    Handle other = take();
+    if (other) {
+      run(other);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> sleeping(sleep_lock);
+    finished.wait(sleeping, [&]() { return job->finished() || queued > 0; });
+  }
+
+  if (job->error) {
+    std::rethrow_exception(job->error);
+  }
+}
+
+void JobSystem::parallelFor(int begin, int end, int grain, const std::function<void(int, int)> &body) {
+  if (end <= begin) {
+    return;
+  }
+  grain = std::max(grain, 1);
+
+  int ranges = (end - begin + grain - 1) / grain;
+  int helpers = std::min(threads(), ranges) - 1;
+
+  std::atomic<int> next{begin};
+  std::mutex error_lock;
+  std::exception_ptr error;
+
+  // every thread takes the next range until there are none left
+  auto ranges_left = [&]() {
+    int from;
+    while ((from = next.fetch_add(grain)) < end) {
+      try {
+        body(from, std::min(from + grain, end));
+      } catch (...) {
+        std::lock_guard<std::mutex> guard(error_lock);
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+    }
+  };
+
+  std::vector<Handle> jobs;
+  for (int i = 0; i < helpers; ++i) {
+    jobs.push_back(submit(ranges_left));
+  }
+  ranges_left();
+
+  // the helpers use this stack frame
+  for (const Handle &job : jobs) {
+    wait(job);
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void JobSystem::workerLoop(int index) {
+  pool = this;
+  own_queue = index;
+
+  for (;;) {
+    Handle job = take();
+    if (job) {
+      run(job);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> sleeping(sleep_lock);
+    wake.wait(sleeping, [&]() { return stopping || queued > 0; });
+    if (stopping) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,85 @@
+#ifndef MAIN_JOBSYSTEM_H
+#define MAIN_JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// a pool of worker threads, each with its own queue of jobs: a worker
+// takes the newest job of its queue and, when that is empty, steals the
+// oldest one from another queue. jobs submitted from other threads go
+// to a queue of their own
+//
+// a job may wait for other jobs, it is queued when the last of them is
+// finished. the thread waiting for a job runs queued jobs meanwhile, so
+// a pool of one thread (no workers) still gets everything done
+class JobSystem {
+public:
+  class Job;
+  typedef std::shared_ptr<Job> Handle;
+
+  // threads, the one waiting included; 0 - one per core
+  explicit JobSystem(int threads = 0);
+  ~JobSystem();
+
+  JobSystem(const JobSystem &) = delete;
+  JobSystem& operator=(const JobSystem &) = delete;
+
+  int threads() const { return int(workers.size()) + 1; }
+
+  // runs work once every job in after is finished
+  Handle submit(std::function<void()> work, const std::vector<Handle> &after = std::vector<Handle>());
+
+  // returns when the job is finished, rethrows what it threw
+  void wait(const Handle &job);
+
+  // calls body(from, to) for ranges of at most grain indices covering
+  // begin..end (exclusive) on all threads, returns when all are done;
+  // the first exception thrown is rethrown
+  void parallelFor(int begin, int end, int grain, const std::function<void(int, int)> &body);
+
+  class Job {
+    friend class JobSystem;
+    std::function<void()> work;
+    std::atomic<int> waiting{1};  // unfinished jobs before it, +1 while submitted
+    std::mutex lock;
+    bool done = false;
+    std::vector<Handle> next;     // jobs waiting for this one
+    std::exception_ptr error;
+  public:
+    bool finished() {
+      std::lock_guard<std::mutex> guard(lock);
+      return done;
+    }
+  };
+
+private:
+  struct Queue {
+    std::mutex lock;
+    std::deque<Handle> jobs;
+  };
+
+  void push(Handle job);
+  Handle take();
+  void run(const Handle &job);
+  void workerLoop(int index);
+
+  std::vector<std::thread> workers;
+  // one per worker, the last one for the other threads
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::atomic<int> queued{0};
+  std::atomic<unsigned> steal_from{0};
+
+  std::mutex sleep_lock;
+  std::condition_variable wake;      // a job was queued
+  std::condition_variable finished;  // a job was finished
+  bool stopping = false;
+};
+
+#endif //MAIN_JOBSYSTEM_H
@@ -0,0 +1,82 @@
+// converts text levels to world files, which are opened without parsing
+//
+// usage:
+//   levelconv FILE [OUT]   saves FILE as a world file (OUT defaults to
+//                          FILE with the .lvl extension), opens it again,
+//                          compares every tile and prints what is in it
+//   levelconv --info FILE  only prints the size, start and exits of a level
+//                          (every chunk is read, so a damaged file is found)
+
+#include "LevelMap.h"
+
+#include <cstring>
+#include <iostream>
+#include <string>
+
+static void printInfo(const std::string &path, const LevelMap &Level, Point starting_pos)
+{
+  std::cout << path << ": " << Level.width() << "x" << Level.height() << " tiles, start ("
+            << starting_pos.x / tileSize << ", " << starting_pos.y / tileSize << "), "
+            << Level.exits().size() << " exits";
+  for (const Point &e : Level.exits())
+    std::cout << " (" << e.x << ", " << e.y << ")";
+  std::cout << std::endl;
+}
+
+static std::string worldPath(const std::string &path)
+{
+  size_t dot = path.rfind('.');
+  size_t slash = path.find_last_of("/\\");
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    return path + ".lvl";
+  return path.substr(0, dot) + ".lvl";
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 2 || argc > 3)
+  {
+    std::cout << "usage: " << argv[0] << " FILE [OUT] | --info FILE" << std::endl;
+    return 1;
+  }
+
+  try {
+    LevelMap source;
+
+    if (!strcmp(argv[1], "--info"))
+    {
+      if (argc != 3)
+        throw std::runtime_error("No file given");
+      Point starting_pos = source.read(argv[2]);
+      for (int y = 0; y < source.height(); y += CHUNK_TILES)
+        for (int x = 0; x < source.width(); x += CHUNK_TILES)
+          source.get(x, y);
+      printInfo(argv[2], source, starting_pos);
+      return 0;
+    }
+
+    std::string out = argc == 3 ? argv[2] : worldPath(argv[1]);
+    Point starting_pos = source.read(argv[1]);
+    source.write(out, starting_pos);
+
+    // the saved file has to give back the same level
+    LevelMap saved;
+    Point saved_pos = saved.read(out);
+    bool same = saved.width() == source.width() && saved.height() == source.height() &&
+                saved_pos.x == starting_pos.x && saved_pos.y == starting_pos.y &&
+                saved.exits().size() == source.exits().size();
+    for (int y = 0; same && y < source.height(); ++y)
+      for (int x = 0; same && x < source.width(); ++x)
+        same = saved.get(x, y) == source.get(x, y);
+
+    if (!same)
+      throw std::runtime_error("The saved level differs from " + std::string(argv[1]));
+
+    printInfo(out, saved, saved_pos);
+  } catch (std::runtime_error &exc) {
+    std::cout << exc.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
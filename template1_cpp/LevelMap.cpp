@@ -0,0 +1,885 @@
+#include "LevelMap.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <stdio.h>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXT_SSE2
+#include <emmintrin.h>
+#endif
+
+// planes a tile belongs to, one bit per TilePlane
+static unsigned tilePlanes(char c) {
+  switch (c) {
+    case '#': return 1u << SOLID;
+    case '%': return 1u << SOLID | 1u << BREAKABLE;
+    case 'b': return 1u << BROKEN;
+    case ' ': return 1u << DEADLY | 1u << ANIMATED;
+    case '*': return 1u << DEADLY | 1u << ANIMATED;
+    case 'x': return 1u << EXIT;
+    default:  return 0;
+  }
+}
+
+struct PlaneTable {
+  uint8_t planes[256];
+
+  PlaneTable() {
+    for (int c = 0; c < 256; ++c) {
+      planes[c] = uint8_t(tilePlanes(char(c)));
+    }
+  }
+
+  unsigned operator[](char c) const { return planes[uint8_t(c)]; }
+};
+
+static const PlaneTable planeTable;
+
+// symbols a text map may have
+static const char TEXT_SYMBOLS[] = " *.#%bx@";
+static const int N_TEXT_SYMBOLS = sizeof(TEXT_SYMBOLS) - 1;
+
+// 0 for the valid ones
+struct SymbolTable {
+  uint8_t invalid[256];
+
+  SymbolTable() {
+    memset(invalid, 1, sizeof(invalid));
+    for (int i = 0; i < N_TEXT_SYMBOLS; ++i) {
+      char c = TEXT_SYMBOLS[i];
+      invalid[uint8_t(c)] = 0;
+    }
+  }
+
+  uint8_t operator[](uint8_t c) const { return invalid[c]; }
+};
+
+static const SymbolTable textSymbols;
+
+constexpr char LevelMap::BORDER;
+
+static const char WORLD_MAGIC[4] = {'E', 'C', 'W', 'D'};
+static const uint32_t WORLD_VERSION = 2;
+static const size_t WORLD_HEADER_BYTES = 40;
+
+// FNV-1a
+static const uint64_t FNV_PRIME = 1099511628211ull;
+static const uint64_t FNV_OFFSET = 14695981039346656037ull;
+
+static uint64_t checksum(const void *data, size_t size, uint64_t hash = FNV_OFFSET) {
+  const unsigned char *p = (const unsigned char *)data;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ p[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+static int lowestBit(uint64_t w) {
+  return __builtin_ctzll(w);
+}
+
+// column of the first symbol of the row a text map may not have,
+// len if there is none; with SSE2 sixteen symbols at a time are
+// compared with every valid one
+static int firstInvalidSymbol(const char *p, int len) {
+  int i = 0;
+#ifdef TEXT_SSE2
+  for (; i + 16 <= len; i += 16) {
+    __m128i row = _mm_loadu_si128((const __m128i *)(p + i));
+    __m128i valid = _mm_setzero_si128();
+    for (int k = 0; k < N_TEXT_SYMBOLS; ++k) {
+      valid = _mm_or_si128(valid, _mm_cmpeq_epi8(row, _mm_set1_epi8(TEXT_SYMBOLS[k])));
+    }
+    unsigned invalid = ~unsigned(_mm_movemask_epi8(valid)) & 0xFFFF;
+    if (invalid != 0) {
+      return i + lowestBit(invalid);
+    }
+  }
+#endif
+  while (i < len && !textSymbols[uint8_t(p[i])]) {
+    i++;
+  }
+  return i;
+}
+
+static uint32_t getU32(const unsigned char *p) {
+  return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+static uint64_t getU64(const unsigned char *p) {
+  return uint64_t(getU32(p)) | uint64_t(getU32(p + 4)) << 32;
+}
+
+static void putU32(unsigned char *p, uint32_t v) {
+  p[0] = uint8_t(v);
+  p[1] = uint8_t(v >> 8);
+  p[2] = uint8_t(v >> 16);
+  p[3] = uint8_t(v >> 24);
+}
+
+static void putU64(unsigned char *p, uint64_t v) {
+  putU32(p, uint32_t(v));
+  putU32(p + 4, uint32_t(v >> 32));
+}
+
+LevelMap::LevelMap() : walls(new Chunk) {
+  walls->own = std::make_shared<ChunkData>();
+  walls->data = walls->base = walls->own.get();
+  ChunkData &data = *walls->own;
+  memset(data.symbols, BORDER, sizeof(data.symbols));
+  memset(data.planes, 0, sizeof(data.planes));
+  for (uint64_t &w : data.planes[SOLID]) {
+    w = ~0ull;
+  }
+  walls->pinned = true;
+  setTable(0, 0);
+}
+
+LevelMap::~LevelMap() = default;
+
+void LevelMap::setTable(int width, int height) {
+  map_width = width;
+  map_height = height;
+  chunks_x = (width + CHUNK_TILES - 1) / CHUNK_TILES;
+  chunks_y = (height + CHUNK_TILES - 1) / CHUNK_TILES;
+
+  // storage of the previous map is reused if it is big enough
+  table.assign(size_t(chunks_x + 2) * (chunks_y + 2), nullptr);
+  for (int cx = 0; cx < chunks_x + 2; ++cx) {
+    table[cx] = walls.get();
+    table[(chunks_y + 1) * (chunks_x + 2) + cx] = walls.get();
+  }
+  for (int cy = 0; cy < chunks_y + 2; ++cy) {
+    table[cy * (chunks_x + 2)] = walls.get();
+    table[cy * (chunks_x + 2) + chunks_x + 1] = walls.get();
+  }
+}
+
+LevelMap::Chunk *LevelMap::allocate() const {
+  if (free_chunks.empty()) {
+    pool.emplace_back(new Chunk);
+    free_chunks.push_back(pool.back().get());
+  }
+  Chunk *c = free_chunks.back();
+  free_chunks.pop_back();
+
+  c->slot = resident.size();
+  resident.push_back(c);
+  stats.resident = resident.size();
+  stats.resident_bytes = resident.size() * sizeof(ChunkData);
+  return c;
+}
+
+void LevelMap::linkUsed(Chunk &c) const {
+  c.older = newest_used;
+  c.newer = nullptr;
+  if (newest_used != nullptr) {
+    newest_used->newer = &c;
+  } else {
+    oldest_used = &c;
+  }
+  newest_used = &c;
+}
+
+void LevelMap::unlinkUsed(Chunk &c) const {
+  (c.newer != nullptr ? c.newer->older : newest_used) = c.older;
+  (c.older != nullptr ? c.older->newer : oldest_used) = c.newer;
+  c.newer = c.older = nullptr;
+}
+
+void LevelMap::pin(Chunk &c) const {
+  if (!c.pinned) {
+    unlinkUsed(c);
+    unpinned--;
+    c.pinned = true;
+  }
+}
+
+void LevelMap::unpin(Chunk &c) const {
+  if (c.pinned) {
+    linkUsed(c);
+    unpinned++;
+    c.pinned = false;
+  }
+}
+
+void LevelMap::evict() const {
+  // least recently used of the chunks that can be brought back
+  Chunk *c = oldest_used;
+  if (c == nullptr) {
+    return;
+  }
+
+  unlinkUsed(*c);
+  table[c->index] = nullptr;
+  free_chunks.push_back(c);
+
+  resident[c->slot] = resident.back();
+  resident[c->slot]->slot = c->slot;
+  resident.pop_back();
+  unpinned--;
+  stats.evictions++;
+  stats.resident = resident.size();
+  stats.resident_bytes = resident.size() * sizeof(ChunkData);
+}
+
+LevelMap::Chunk &LevelMap::load(int cx, int cy) const {
+  if ((world.empty() && text_chunks.empty()) || cx < 0 || cy < 0 || cx >= chunks_x || cy >= chunks_y) {
+    return *walls;
+  }
+
+  stats.misses++;
+
+  size_t n = size_t(cy) * chunks_x + cx;
+  const ChunkData *base;
+
+  if (world.empty()) {
+    // the whole text map is in memory, nothing to drop
+    base = &text_chunks[n];
+  } else {
+    const unsigned char *record = world.data() + data_offset + n * sizeof(ChunkData);
+
+    // each chunk is checked once, the first time it is used; a corrupt
+    // one stays walls for as long as the map is open
+    if (!verified[n]) {
+      const unsigned char *sums = world.data() + WORLD_HEADER_BYTES + exit_tiles.size() * 8;
+      if (checksum(record, sizeof(ChunkData)) != getU64(sums + n * 8)) {
+        chunk_error = "World file is corrupt: chunk " + std::to_string(cx) + ", " + std::to_string(cy) +
+                      " is shown as walls";
+        table[(cy + 1) * (chunks_x + 2) + cx + 1] = walls.get();
+        return *walls;
+      }
+      verified[n] = true;
+    }
+    base = (const ChunkData *)record;
+
+    if (unpinned >= size_t(std::max(chunk_budget, std::max(stream_chunks, 1)))) {
+      evict();
+    }
+  }
+
+  Chunk *c = allocate();
+  c->index = (cy + 1) * (chunks_x + 2) + cx + 1;
+  c->pinned = true;
+  c->data = c->base = base;
+  c->own.reset();
+  c->kept = false;
+  if (!world.empty()) {
+    unpin(*c);
+  }
+
+  table[c->index] = c;
+  return *c;
+}
+
+LevelMap::ChunkData &LevelMap::writable(int cx, int cy) {
+  chunkAt(cx, cy);
+  Chunk &c = *table[(cy + 1) * (chunks_x + 2) + cx + 1];
+
+  if (&c == walls.get()) {
+    throw std::runtime_error("World file is corrupt");
+  }
+
+  if (!c.own) {
+    // a changed chunk can not be brought back from the file
+    pin(c);
+    changed.push_back(&c);
+    c.own = std::make_shared<ChunkData>(*c.data);
+  } else if (c.own.use_count() > 1) {
+    // the tiles are kept by a snapshot
+    c.own = std::make_shared<ChunkData>(*c.own);
+  }
+  c.data = c.own.get();
+  return *c.own;
+}
+
+void LevelMap::replace(Chunk &c, const ChunkData *tiles) {
+  if (c.data == tiles) {
+    return;
+  }
+
+  int cx = c.index % (chunks_x + 2) - 1,
+      cy = c.index / (chunks_x + 2) - 1;
+  int rows = std::min(CHUNK_TILES, map_height - cy * CHUNK_TILES);
+
+  for (int y = 0; y < rows; ++y) {
+    const char *a = c.data->symbols + y * CHUNK_TILES,
+               *b = tiles->symbols + y * CHUNK_TILES;
+    uint64_t differ = 0;
+    for (int i = 0; i < CHUNK_TILES; ++i) {
+      differ |= uint64_t(a[i] != b[i]) << i;
+    }
+    markRow(cy * CHUNK_TILES + y, cx, differ);
+  }
+  c.data = tiles;
+}
+
+LevelMap::Snapshot LevelMap::snapshot() const {
+  Snapshot s;
+  s.chunks.reserve(changed.size());
+  for (const Chunk *c : changed) {
+    s.chunks.emplace_back(c->index, c->own);
+  }
+  return s;
+}
+
+void LevelMap::changedTiles(std::vector<TileChange> &out) const {
+  for (const Chunk *c : changed) {
+    int cx = c->index % (chunks_x + 2) - 1;
+    int cy = c->index / (chunks_x + 2) - 1;
+    int w = std::min(CHUNK_TILES, map_width - cx * CHUNK_TILES);
+    int h = std::min(CHUNK_TILES, map_height - cy * CHUNK_TILES);
+
+    for (int y = 0; y < h; ++y) {
+      const char *now = c->own->symbols + y * CHUNK_TILES;
+      const char *was = c->base->symbols + y * CHUNK_TILES;
+      for (int x = 0; x < w; ++x) {
+        if (now[x] != was[x]) {
+          out.push_back(TileChange{cx * CHUNK_TILES + x, cy * CHUNK_TILES + y, frame(was[x]), frame(now[x])});
+        }
+      }
+    }
+  }
+}
+
+void LevelMap::restore(const Snapshot &s) {
+  std::vector<Chunk *> before;
+  before.swap(changed);
+
+  // chunks of the snapshot get its tiles
+  for (const auto &tiles : s.chunks) {
+    chunkAt(tiles.first % (chunks_x + 2) - 1, tiles.first / (chunks_x + 2) - 1);
+    Chunk &c = *table[tiles.first];
+
+    replace(c, tiles.second.get());
+    pin(c);
+    c.own = tiles.second;
+    c.kept = true;
+    changed.push_back(&c);
+  }
+
+  // the rest of the chunks changed since then go back to what was read
+  for (Chunk *c : before) {
+    if (c->kept) {
+      continue;
+    }
+    replace(*c, c->base);
+    c->own.reset();
+    if (!world.empty()) {
+      unpin(*c);
+    }
+  }
+
+  for (Chunk *c : changed) {
+    c->kept = false;
+  }
+}
+
+void LevelMap::setPlanes(ChunkData &c, int x, int y, char s) {
+  unsigned in = planeTable[s];
+  uint64_t bit = 1ull << x;
+
+  for (int p = 0; p < N_PLANES; ++p) {
+    c.planes[p][y] = (in >> p & 1) ? c.planes[p][y] | bit : c.planes[p][y] & ~bit;
+  }
+}
+
+void LevelMap::set(int x, int y, char c) {
+  if (c != ' ' && c != '*' && c != '.' && c != '#' && c != '%' && c != 'b' && c != 'x'&& c != '@') {
+    throw std::runtime_error("No such tile");
+  }
+  if (x < 0 || y < 0 || x >= map_width || y >= map_height) {
+    throw std::runtime_error("Tile is outside the map");
+  }
+
+  if (change_log != nullptr) {
+    change_log->push_back(TileChange{x, y, get(x, y), c});
+  }
+
+  ChunkData &chunk = writable(x >> 6, y >> 6);
+  chunk.symbols[(y & 63) * CHUNK_TILES + (x & 63)] = frame(c);
+  setPlanes(chunk, x & 63, y & 63, c);
+  markRow(y, x >> 6, 1ull << (x & 63));
+}
+
+void LevelMap::markRow(int y, int w, uint64_t mask) {
+  if (dirty == nullptr) {
+    return;
+  }
+
+  // one rectangle per run of set bits
+  while (mask != 0) {
+    int lo = lowestBit(mask);
+    uint64_t run = mask >> lo;
+    int len = ~run == 0 ? 64 - lo : lowestBit(~run);
+
+    Rect tile_run{(w * 64 + lo) * tileSize, y * tileSize, len * tileSize, tileSize};
+    dirty->add(camera->toScreen(tile_run));
+
+    mask = len + lo == 64 ? 0 : mask & (~0ull << (lo + len));
+  }
+}
+
+unsigned LevelMap::neighbours(TilePlane p, int x, int y) const {
+  // the wall chunks around the map keep all four lookups valid
+  return (planeTable[get(x - 1, y)] >> p & 1) * NEIGHBOUR_LEFT |
+         (planeTable[get(x + 1, y)] >> p & 1) * NEIGHBOUR_RIGHT |
+         (planeTable[get(x, y - 1)] >> p & 1) * NEIGHBOUR_DOWN |
+         (planeTable[get(x, y + 1)] >> p & 1) * NEIGHBOUR_UP;
+}
+
+Point LevelMap::read(const std::string &file) {
+
+  MappedFile mapped(file);
+  if (mapped.size() >= sizeof(WORLD_MAGIC) && std::equal(WORLD_MAGIC, WORLD_MAGIC + sizeof(WORLD_MAGIC), mapped.data())) {
+    return openWorld(std::move(mapped));
+  }
+  return readText((const char *)mapped.data(), mapped.size());
+}
+
+Point LevelMap::openWorld(MappedFile &&mapped) {
+
+  const unsigned char *header = mapped.data();
+  if (mapped.size() < WORLD_HEADER_BYTES || getU32(header + 4) != WORLD_VERSION) {
+    throw std::runtime_error("Unsupported world file version");
+  }
+
+  uint32_t width = getU32(header + 8),
+           height = getU32(header + 12);
+  if (width == 0 || height == 0) {
+    throw std::runtime_error("The map is empty");
+  }
+  if (width > uint32_t(MAX_MAP_TILES) || height > uint32_t(MAX_MAP_TILES)) {
+    throw std::runtime_error("The map is too big");
+  }
+
+  size_t n_exits = getU32(header + 24),
+         offset = getU32(header + 28);
+  size_t n_chunks = size_t((width + CHUNK_TILES - 1) / CHUNK_TILES) * ((height + CHUNK_TILES - 1) / CHUNK_TILES);
+
+  if (offset % 64 != 0 || offset < WORLD_HEADER_BYTES + (n_exits + n_chunks) * 8 ||
+      mapped.size() < offset + n_chunks * sizeof(ChunkData)) {
+    throw std::runtime_error("World file is truncated");
+  }
+
+  uint64_t sum = checksum(header, 32);
+  sum = checksum(header + WORLD_HEADER_BYTES, offset - WORLD_HEADER_BYTES, sum);
+  if (sum != getU64(header + 32)) {
+    throw std::runtime_error("World file is corrupt");
+  }
+
+  exit_tiles.clear();
+  for (size_t i = 0; i < n_exits; ++i) {
+    const unsigned char *e = header + WORLD_HEADER_BYTES + i * 8;
+    exit_tiles.push_back(Point{int(getU32(e)), int(getU32(e + 4))});
+  }
+
+  Point starting_pos{ .x = int(getU32(header + 16)) * tileSize, .y = int(getU32(header + 20)) * tileSize};
+
+  // nothing is touched until it is looked at
+  world = std::move(mapped);
+  data_offset = offset;
+  verified.assign(n_chunks, false);
+  setTable(int(width), int(height));
+  space_frame = false;
+
+  return starting_pos;
+}
+
+static std::runtime_error textError(int line, int column, const std::string &what) {
+  std::string where = "line " + std::to_string(line);
+  if (column > 0) {
+    where += ", column " + std::to_string(column);
+  }
+  return std::runtime_error(where + ": " + what);
+}
+
+Point LevelMap::readText(const char *text, size_t size) {
+
+  // the first pass finds the rows and checks every symbol
+  std::vector<const char *> rows;
+  int width = 0, first_line = 0, line = 0;
+  const char *end = text + size;
+
+  for (const char *p = text; p < end; ) {
+    const char *eol = (const char *)memchr(p, '\n', end - p);
+    const char *next = eol == nullptr ? end : eol + 1;
+    if (eol == nullptr) {
+      eol = end;
+    }
+    if (eol > p && eol[-1] == '\r') {
+      eol--;
+    }
+    line++;
+
+    int len = int(eol - p);
+    // empty lines and comments are skipped
+    if (len == 0 || *p == COMMENT) {
+      p = next;
+      continue;
+    }
+
+    int column = firstInvalidSymbol(p, len);
+    if (column < len) {
+      char c = p[column];
+      std::string symbol = isprint((unsigned char) c) ? std::string("'") + c + "'" : "code " + std::to_string(uint8_t(c));
+      throw textError(line, column + 1, "unknown tile " + symbol);
+    }
+
+    if (width == 0) {
+      width = len;
+      first_line = line;
+    } else if (len != width) {
+      throw textError(line, std::min(len, width) + 1, "the row has " + std::to_string(len) + " tiles, the first one (line " +
+                      std::to_string(first_line) + ") has " + std::to_string(width));
+    }
+    if (width > MAX_MAP_TILES || int(rows.size()) == MAX_MAP_TILES) {
+      throw textError(line, 0, "the map is too big");
+    }
+
+    rows.push_back(p);
+    p = next;
+  }
+
+  if (rows.empty()) {
+    throw std::runtime_error("The map is empty");
+  }
+  int height = int(rows.size());
+
+  // a text map is kept whole, its chunks are never dropped
+  setTable(width, height);
+  space_frame = false;
+  exit_tiles.clear();
+  text_chunks.assign(size_t(chunks_x) * chunks_y, *walls->data);
+
+  // the second pass copies rows a chunk wide and builds their planes
+  Point starting_pos{ .x = width * tileSize / 2, .y = height * tileSize / 2};
+
+  for (int y = 0; y < height; ++y) {
+    for (int cx = 0; cx < chunks_x; ++cx) {
+      ChunkData &chunk = text_chunks[size_t(y >> 6) * chunks_x + cx];
+      char *symbols = chunk.symbols + (y & 63) * CHUNK_TILES;
+      int n = std::min(CHUNK_TILES, width - cx * CHUNK_TILES);
+      memcpy(symbols, rows[y] + cx * CHUNK_TILES, n);
+
+      // player is standing on the floor
+      for (char *at = symbols; (at = (char *)memchr(at, '@', symbols + n - at)) != nullptr; ++at) {
+        starting_pos.x = (cx * CHUNK_TILES + int(at - symbols)) * tileSize;
+        starting_pos.y = y * tileSize;
+        *at = '.';
+      }
+
+      // planes of eight tiles at a time: one byte per tile,
+      // then bit p of every byte is gathered into a byte of plane p
+      uint64_t planes[N_PLANES] = {};
+      for (int i = 0; i < n; i += 8) {
+        uint64_t in = 0;
+        for (int j = 0; j < 8 && i + j < n; ++j) {
+          in |= uint64_t(planeTable[symbols[i + j]]) << (8 * j);
+        }
+        for (int p = 0; p < N_PLANES; ++p) {
+          planes[p] |= (((in >> p) & 0x0101010101010101ull) * 0x0102040810204080ull >> 56) << i;
+        }
+      }
+
+      // tiles past the right edge stay walls
+      uint64_t inside = tileSpan(0, n - 1);
+      for (int p = 0; p < N_PLANES; ++p) {
+        chunk.planes[p][y & 63] = (chunk.planes[p][y & 63] & ~inside) | planes[p];
+      }
+
+      for (uint64_t bits = planes[EXIT]; bits != 0; bits &= bits - 1) {
+        exit_tiles.push_back(Point{cx * CHUNK_TILES + lowestBit(bits), y});
+      }
+    }
+  }
+
+  return starting_pos;
+}
+
+void LevelMap::write(const std::string &file, Point starting_pos) const {
+  size_t n_chunks = size_t(chunks_x) * chunks_y;
+
+  // exits are found in the planes, so the header matches the tiles
+  std::vector<Point> exits;
+  for (int y = 0; y < map_height; ++y) {
+    for (int w = 0; w < chunks_x; ++w) {
+      for (uint64_t bits = word(EXIT, y, w); bits != 0; bits &= bits - 1) {
+        exits.push_back(Point{w * 64 + lowestBit(bits), y});
+      }
+    }
+  }
+
+  size_t offset = WORLD_HEADER_BYTES + (exits.size() + n_chunks) * 8;
+  offset = (offset + 63) / 64 * 64;
+
+  // the header is written last, after the chunk checksums are known
+  std::vector<unsigned char> header(offset, 0);
+  std::copy(WORLD_MAGIC, WORLD_MAGIC + sizeof(WORLD_MAGIC), header.begin());
+  putU32(&header[4], WORLD_VERSION);
+  putU32(&header[8], uint32_t(map_width));
+  putU32(&header[12], uint32_t(map_height));
+  putU32(&header[16], uint32_t(starting_pos.x / tileSize));
+  putU32(&header[20], uint32_t(starting_pos.y / tileSize));
+  putU32(&header[24], uint32_t(exits.size()));
+  putU32(&header[28], uint32_t(offset));
+
+  for (size_t i = 0; i < exits.size(); ++i) {
+    putU32(&header[WORLD_HEADER_BYTES + i * 8], uint32_t(exits[i].x));
+    putU32(&header[WORLD_HEADER_BYTES + i * 8 + 4], uint32_t(exits[i].y));
+  }
+
+  FILE *f = fopen(file.c_str(), "wb");
+  if (f == nullptr) {
+    throw std::runtime_error("Unable to open file " + file);
+  }
+
+  fwrite(header.data(), 1, header.size(), f);
+
+  size_t sums = WORLD_HEADER_BYTES + exits.size() * 8;
+  for (int cy = 0; cy < chunks_y; ++cy) {
+    for (int cx = 0; cx < chunks_x; ++cx) {
+      const ChunkData &chunk = chunkAt(cx, cy);
+      fwrite(&chunk, 1, sizeof(ChunkData), f);
+      putU64(&header[sums + (size_t(cy) * chunks_x + cx) * 8], checksum(&chunk, sizeof(ChunkData)));
+    }
+  }
+
+  uint64_t sum = checksum(header.data(), 32);
+  sum = checksum(header.data() + WORLD_HEADER_BYTES, offset - WORLD_HEADER_BYTES, sum);
+  putU64(&header[32], sum);
+
+  rewind(f);
+  fwrite(header.data(), 1, header.size(), f);
+
+  bool failed = ferror(f) != 0;
+  if (fclose(f) != 0 || failed) {
+    throw std::runtime_error("Unable to write file " + file);
+  }
+}
+
+void LevelMap::stream(const Rect &area) {
+  const int chunk_pixels = CHUNK_TILES * tileSize;
+
+  int cx0 = std::max(area.x / chunk_pixels - 1, 0),
+      cy0 = std::max(area.y / chunk_pixels - 1, 0),
+      cx1 = std::min((area.x + area.w - 1) / chunk_pixels + 1, chunks_x - 1),
+      cy1 = std::min((area.y + area.h - 1) / chunk_pixels + 1, chunks_y - 1);
+  stream_chunks = std::max(stream_chunks, (cx1 - cx0 + 1) * (cy1 - cy0 + 1));
+
+  for (int cy = cy0; cy <= cy1; ++cy) {
+    for (int cx = cx0; cx <= cx1; ++cx) {
+      chunkAt(cx, cy);
+    }
+  }
+}
+
+// rounds towards minus infinity, the screen may start below the map
+static int floorDiv(int a, int b) {
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+void LevelMap::draw(Image &screen, const TileAtlas &tiles, JobSystem *jobs) {
+  drawArea(screen, tiles, Rect{0, 0, screen.Width(), screen.Height()}, jobs);
+}
+
+void LevelMap::drawArea(Image &screen, const TileAtlas &tiles, const Rect &area, JobSystem *jobs) {
+  Rect clip = Intersect(area, Rect{0, 0, screen.Width(), screen.Height()});
+  collectDrawn(clip);
+
+  if (jobs == nullptr || jobs->threads() == 1 || clip.h <= DRAW_BAND_TILES * tileSize) {
+    paint(screen, tiles, clip);
+    return;
+  }
+
+  // bands start at the edge of a tile row, the rows of the screen
+  // a band writes are written by no other band, so nothing is locked;
+  // chunks were looked up on this thread, the bands only read them
+  int oy = camera != nullptr ? camera->originY() : 0;
+  int dy = floorDiv(clip.y + oy, tileSize),
+      uy = floorDiv(clip.y + clip.h - 1 + oy, tileSize);
+
+  jobs->parallelFor(dy, uy + 1, DRAW_BAND_TILES, [&](int ty0, int ty1) {
+    int y0 = std::max(ty0 * tileSize - oy, clip.y),
+        y1 = std::min(ty1 * tileSize - oy, clip.y + clip.h);
+    paint(screen, tiles, Rect{clip.x, y0, clip.w, y1 - y0});
+  });
+}
+
+void LevelMap::collectDrawn(const Rect &area) {
+  int ox = camera != nullptr ? camera->originX() : 0,
+      oy = camera != nullptr ? camera->originY() : 0;
+
+  // the tiles under the area, in the map
+  int lx = std::max(area.x + ox, 0) / tileSize,
+      dy = std::max(area.y + oy, 0) / tileSize,
+      rx = std::min((area.x + area.w - 1 + ox) / tileSize, map_width - 1),
+      uy = std::min((area.y + area.h - 1 + oy) / tileSize, map_height - 1);
+
+  drawn.clear();
+  drawn_cx0 = lx / CHUNK_TILES;
+  drawn_cy0 = dy / CHUNK_TILES;
+  drawn_w = 0;
+  if (area.Empty() || lx > rx || dy > uy) {
+    return;
+  }
+
+  // a chunk that is dropped meanwhile still points at the mapped file
+  drawn_w = rx / CHUNK_TILES - drawn_cx0 + 1;
+  for (int cy = drawn_cy0; cy <= uy / CHUNK_TILES; ++cy) {
+    for (int cx = drawn_cx0; cx <= rx / CHUNK_TILES; ++cx) {
+      drawn.push_back(&chunkAt(cx, cy));
+    }
+  }
+}
+
+void LevelMap::paint(Image &screen, const TileAtlas &tiles, const Rect &area) const {
+  Rect clip = Intersect(area, Rect{0, 0, screen.Width(), screen.Height()});
+  if (clip.Empty()) {
+    return;
+  }
+
+  int ox = camera != nullptr ? camera->originX() : 0,
+      oy = camera != nullptr ? camera->originY() : 0;
+
+  // the map in screen pixels
+  Rect map = Rect{-ox, -oy, map_width * tileSize, map_height * tileSize};
+  Rect inside = Intersect(clip, map);
+
+  if (inside.w != clip.w || inside.h != clip.h) {
+    for (int sy = clip.y; sy < clip.y + clip.h; ++sy) {
+      Pixel *row = screen.Data() + sy * screen.Width();
+      bool in_rows = !inside.Empty() && sy >= inside.y && sy < inside.y + inside.h;
+
+      for (int sx = clip.x; sx < clip.x + clip.w; ++sx) {
+        if (!in_rows || sx < inside.x || sx >= inside.x + inside.w) {
+          row[sx] = backgroundColor;
+        }
+      }
+    }
+  }
+
+  if (inside.Empty()) {
+    return;
+  }
+
+  int lx = (inside.x + ox) / tileSize,
+      rx = (inside.x + inside.w - 1 + ox) / tileSize,
+      dy = (inside.y + oy) / tileSize,
+      uy = (inside.y + inside.h - 1 + oy) / tileSize;
+
+  // the screen is written row after row of pixels; the tiles of a row
+  // are looked up once for all of its pixel rows, a chunk at a time
+  uint8_t ids[CHUNK_TILES];
+  for (int ty = dy; ty <= uy; ++ty) {
+    int top = ty * tileSize - oy;
+    int sy0 = std::max(top, inside.y),
+        sy1 = std::min(top + tileSize, inside.y + inside.h);
+
+    for (int cx = lx / CHUNK_TILES; cx <= rx / CHUNK_TILES; ++cx) {
+      int tx0 = std::max(lx, cx * CHUNK_TILES),
+          tx1 = std::min(rx, cx * CHUNK_TILES + CHUNK_TILES - 1);
+
+      const char *symbols = drawnRow(cx, ty);
+      for (int tx = tx0; tx <= tx1; ++tx) {
+        ids[tx - tx0] = uint8_t(tiles.id(frame(symbols[tx & 63])));
+      }
+
+      // the first and the last tile may be cut by the area
+      int sx0 = std::max(tx0 * tileSize - ox, inside.x),
+          sx1 = std::min((tx1 + 1) * tileSize - ox, inside.x + inside.w);
+      int first = (sx0 + ox) / tileSize - tx0,
+          cut = (sx0 + ox) % tileSize;
+      for (int sy = sy0; sy < sy1; ++sy) {
+        Pixel *row = screen.Data() + sy * screen.Width();
+        int y = sy - top, sx = sx0, i = first;
+
+        if (cut != 0) {
+          int count = std::min(tileSize - cut, sx1 - sx);
+          tiles.drawRow(ids[i++], cut, y, row + sx, count);
+          sx += count;
+        }
+        for (; sx + tileSize <= sx1; sx += tileSize) {
+          tiles.drawRow(ids[i++], y, row + sx);
+        }
+        if (sx < sx1) {
+          tiles.drawRow(ids[i], 0, y, row + sx, sx1 - sx);
+        }
+      }
+    }
+  }
+}
+
+void LevelMap::animation() {
+  
+  space_animation = (space_animation + 1) % ANIMATION_FREQUENCY;
+
+  if (!space_animation) {
+
+    // every space tile switches to the other frame,
+    // only what is on the screen has to be repainted
+    space_frame = !space_frame;
+    markAnimated();
+  }
+
+}
+
+void LevelMap::markAnimated() {
+  if (dirty == nullptr || map_width == 0) {
+    return;
+  }
+
+  Rect view = camera->shown();
+  int lx = view.x / tileSize,
+      rx = (view.x + view.w - 1) / tileSize,
+      dy = view.y / tileSize,
+      uy = (view.y + view.h - 1) / tileSize;
+
+  rx = rx < map_width ? rx : map_width - 1;
+  uy = uy < map_height ? uy : map_height - 1;
+
+  for (int y = dy; y <= uy; ++y) {
+    for (int w = lx >> 6; w <= rx >> 6; ++w) {
+      markRow(y, w, word(ANIMATED, y, w) & tileSpan(lx - w * 64, rx - w * 64));
+    }
+  }
+}
+
+void LevelMap::setAnimation(int tick, bool frame) {
+  space_animation = tick;
+  if (space_frame != frame) {
+    space_frame = frame;
+    markAnimated();
+  }
+}
+
+void LevelMap::restart(int animation_tick) {
+  restore(Snapshot());
+  space_animation = animation_tick;
+  space_frame = false;
+}
+
+void LevelMap::reset() {
+  // chunks go back to the pool for the next map
+  for (Chunk *chunk : resident) {
+    chunk->own.reset();
+    free_chunks.push_back(chunk);
+  }
+  resident.clear();
+  changed.clear();
+  unpinned = 0;
+  newest_used = oldest_used = nullptr;
+  stream_chunks = 0;
+  chunk_error.clear();
+  stats.resident = 0;
+  stats.resident_bytes = 0;
+
+  world = MappedFile();
+  text_chunks.clear();
+  exit_tiles.clear();
+  setTable(0, 0);
+  space_frame = false;
+}
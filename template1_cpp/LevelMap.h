@@ -0,0 +1,354 @@
+#ifndef MAIN_LEVELMAP_H
+#define MAIN_LEVELMAP_H
+
+#include "Config.h"
+#include "Player.h"
+#include "TileAtlas.h"
+#include "DirtyRegions.h"
+#include "Camera.h"
+#include "MappedFile.h"
+#include "JobSystem.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// bitboard planes kept next to the tile symbols:
+// bit x % 64 of word x / 64 of row y is set if tile (x, y) has the property
+enum TilePlane {
+  SOLID,     // '#', '%': stops the player
+  BREAKABLE, // '%'
+  BROKEN,    // 'b': restored to '%' on restart
+  DEADLY,    // ' ', '*'
+  EXIT,      // 'x'
+  ANIMATED,  // ' ', '*': switch frames every ANIMATION_FREQUENCY ticks
+  N_PLANES
+};
+
+// bits x0..x1 (inclusive) of a word, clipped to the word
+inline uint64_t tileSpan(int x0, int x1) {
+  x0 = x0 > 0 ? x0 : 0;
+  x1 = x1 < 63 ? x1 : 63;
+  if (x0 > x1) {
+    return 0;
+  }
+  return (~0ull >> (63 - x1)) & (~0ull << x0);
+}
+
+constexpr unsigned NEIGHBOUR_LEFT  = 1,
+                   NEIGHBOUR_RIGHT = 2,
+                   NEIGHBOUR_DOWN  = 4,
+                   NEIGHBOUR_UP    = 8;
+
+// the map is stored in square chunks, a row of a chunk
+// is exactly one word of every plane
+constexpr int CHUNK_TILES = 64;
+
+// rows of tiles drawn by one job of a full redraw
+constexpr int DRAW_BAND_TILES = 4;
+
+// binary level (world) file, little endian:
+//    0  "ECWD"
+//    4  version (uint32)
+//    8  width, height (uint32 each, in tiles)
+//   16  start x, start y (uint32 each, in tiles)
+//   24  number of exits (uint32)
+//   28  offset of the chunk data (uint32, a multiple of 64)
+//   32  checksum (uint64) of the first 32 bytes and of everything
+//       from byte 40 up to the chunk data
+//   40  exits, x and y (uint32 each) for every exit tile
+//       then a checksum (uint64) of every chunk
+//   chunk data: ceil(width / 64) x ceil(height / 64) chunks, bottom
+//   row first, each laid out as ChunkData (symbols, then planes);
+//   tiles past the edge of the map are '#'
+//
+// a world file is mapped into memory and its chunks are used in place:
+// a chunk is checked against its checksum the first time it is needed
+// (a corrupt one is replaced by walls, so looking up a tile never
+// throws) and copied only when one of its tiles changes. the least
+// recently used chunks are dropped from the table when more than the
+// budget are in use; changed chunks stay
+//
+// the map as it was read is never changed: a snapshot shares the
+// copies of the changed chunks and restoring one only touches the chunks
+// changed since, so going back to the start of a level costs as much
+// as what was changed on it
+
+// a tile set during a tick, for going back in time
+struct TileChange {
+  int x;
+  int y;
+  char before;
+  char after;
+};
+
+// chunk cache counters
+struct ChunkStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+  size_t resident = 0;       // chunks in use
+  size_t resident_bytes = 0;
+};
+
+class LevelMap {
+
+  // tiles of a chunk, the same in memory and in a world file
+  struct ChunkData {
+    char symbols[CHUNK_TILES * CHUNK_TILES];
+    uint64_t planes[N_PLANES][CHUNK_TILES];
+  };
+
+public:
+  LevelMap();
+  ~LevelMap();
+
+  LevelMap(const LevelMap &) = delete;
+  LevelMap& operator=(const LevelMap &) = delete;
+
+  // size in tiles
+  int width() const { return map_width; }
+  int height() const { return map_height; }
+
+  // x and y may also be one tile outside the map,
+  // the border is made of unbreakable walls
+  char get(int x, int y) const {
+    return frame(chunkAt(x >> 6, y >> 6).symbols[(y & 63) * CHUNK_TILES + (x & 63)]);
+  }
+
+  void set(int x, int y, char c);
+
+  // word w of row y of a plane, words outside the map are empty
+  uint64_t word(TilePlane p, int y, int w) const {
+    return y >= 0 && y < map_height && w >= 0 && w < chunks_x ? chunkAt(w, y >> 6).planes[p][y & 63] : 0;
+  }
+
+  bool test(TilePlane p, int x, int y) const {
+    return x >= 0 && x < map_width && (word(p, y, x >> 6) >> (x & 63) & 1);
+  }
+
+  // true if any tile of the rectangle x0..x1, y0..y1 (inclusive)
+  // is in the plane
+  bool any(TilePlane p, int x0, int y0, int x1, int y1) const {
+    x0 = x0 > 0 ? x0 : 0;
+    y0 = y0 > 0 ? y0 : 0;
+    x1 = x1 < map_width - 1 ? x1 : map_width - 1;
+    y1 = y1 < map_height - 1 ? y1 : map_height - 1;
+
+    for (int y = y0; y <= y1; ++y) {
+      for (int w = x0 >> 6; w <= x1 >> 6; ++w) {
+        if (chunkAt(w, y >> 6).planes[p][y & 63] & tileSpan(x0 - w * 64, x1 - w * 64)) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // which of the four neighbours of (x, y) are in the plane,
+  // see the NEIGHBOUR_* bits; the border counts as unbreakable walls
+  unsigned neighbours(TilePlane p, int x, int y) const;
+
+  // the tiles changed since the map was read; an empty snapshot
+  // is the map as it was read
+  class Snapshot {
+    friend class LevelMap;
+    // table index and tiles of every changed chunk
+    std::vector<std::pair<int, std::shared_ptr<ChunkData>>> chunks;
+  public:
+    size_t changedChunks() const { return chunks.size(); }
+    // most memory its tiles may hold alone
+    size_t bytes() const { return chunks.size() * sizeof(ChunkData); }
+  };
+
+  Snapshot snapshot() const;
+
+  // brings back the tiles of a snapshot of this map,
+  // the tiles that change are marked for repainting
+  void restore(const Snapshot &s);
+
+  // appends every tile that differs from the map as it was read
+  void changedTiles(std::vector<TileChange> &out) const;
+
+  // every tile set from now on is appended to the log (nullptr stops it)
+  void recordChanges(std::vector<TileChange> *log) { change_log = log; }
+
+  // tile changes are reported to the tracker from now on,
+  // at the place the camera shows them
+  void track(DirtyRegions &regions, const Camera &view) {
+    dirty = &regions;
+    camera = &view;
+  }
+
+  // read map from a text file, one line per row of tiles
+  // (the first line is the bottom row), all rows of the same length;
+  // empty lines and lines starting with ';' are skipped, errors
+  // tell the line and column. a world file is opened instead
+  // returns player starting position
+  Point read(const std::string &file);
+
+  // saves the map as a world file
+  void write(const std::string &file, Point starting_pos) const;
+
+  // exit tiles, from the world file header or found while reading text
+  const std::vector<Point> &exits() const { return exit_tiles; }
+
+  // brings in the chunks under the area (in world pixels)
+  // and one chunk around it ahead of time
+  void stream(const Rect &area);
+
+  // most chunks of a world file kept in use, not counting changed ones;
+  // never fewer than stream() brings in at once, or they would push
+  // each other out every frame
+  void setChunkBudget(int chunks) { chunk_budget = chunks; }
+  const ChunkStats &chunkStats() const { return stats; }
+
+  // a chunk of the world file that did not match its checksum, once;
+  // such a chunk is shown and played as walls
+  std::string error() {
+    std::string e;
+    e.swap(chunk_error);
+    return e;
+  }
+
+  // draws the part of the map the camera shows over the whole screen
+  void draw(Image &screen, const TileAtlas &tiles, JobSystem *jobs = nullptr);
+
+  // repaint the area of the screen (in pixels),
+  // whatever is outside the map is cleared; with jobs an area taller
+  // than a band is drawn in bands of DRAW_BAND_TILES tile rows at once
+  void drawArea(Image &screen, const TileAtlas &tiles, const Rect &area, JobSystem *jobs = nullptr);
+
+  // switches space tiles to their other frame every ANIMATION_FREQUENCY
+  // ticks; only the ones on the screen are marked for repainting
+  void animation();
+
+  void reset();
+
+  // goes back to the map as it was read
+  // with the space animation at the given tick
+  void restart(int animation_tick);
+  int animationTick() const { return space_animation; }
+  bool animationFrame() const { return space_frame; }
+
+  // puts the space animation at a tick and frame, the space tiles
+  // on the screen are marked if the frame changes
+  void setAnimation(int tick, bool frame);
+
+private:
+  struct Chunk {
+    const ChunkData *data;           // base or own
+    const ChunkData *base;           // as read, in the mapped file or the text
+    std::shared_ptr<ChunkData> own;  // changed tiles, maybe shared with snapshots
+    // neighbours in the list of chunks that may be dropped
+    Chunk *newer = nullptr;
+    Chunk *older = nullptr;
+    size_t slot;   // in resident
+    int index;     // in the chunk table
+    bool pinned;   // changed or not backed by a file, never dropped
+    bool kept;     // in the snapshot being restored
+  };
+
+  // chunks around the map are all walls; a missing chunk is loaded
+  const ChunkData &chunkAt(int cx, int cy) const {
+    Chunk *c = table[(cy + 1) * (chunks_x + 2) + cx + 1];
+    if (c == nullptr) {
+      c = &load(cx, cy);
+    } else {
+      stats.hits++;
+    }
+    if (c != newest_used && !c->pinned) {
+      unlinkUsed(*c);
+      linkUsed(*c);
+    }
+    return *c->data;
+  }
+
+  // the chunk's own copy of its tiles, made on the first change
+  // and again when it is shared with a snapshot
+  ChunkData &writable(int cx, int cy);
+  // shows other tiles in the chunk, marking the ones that differ
+  void replace(Chunk &c, const ChunkData *tiles);
+
+  Chunk &load(int cx, int cy) const;
+  Chunk *allocate() const;
+  void evict() const;
+  // the list of chunks that may be dropped, newest first
+  void linkUsed(Chunk &c) const;
+  void unlinkUsed(Chunk &c) const;
+  // a pinned chunk stays until the map is reset
+  void pin(Chunk &c) const;
+  void unpin(Chunk &c) const;
+  void setTable(int width, int height);
+
+  Point readText(const char *text, size_t size);
+  Point openWorld(MappedFile &&mapped);
+
+  // looks up the chunks under the area of the screen for paint()
+  void collectDrawn(const Rect &area);
+  // repaints the area from the chunks collected, touches nothing
+  // but the screen pixels of the area
+  void paint(Image &screen, const TileAtlas &tiles, const Rect &area) const;
+  // symbols of row y of chunk column cx, as stored
+  const char *drawnRow(int cx, int y) const {
+    return drawn[((y >> 6) - drawn_cy0) * drawn_w + cx - drawn_cx0]->symbols + (y & 63) * CHUNK_TILES;
+  }
+
+  void setPlanes(ChunkData &c, int x, int y, char s);
+  // marks the tiles of row y set in word w of mask
+  void markRow(int y, int w, uint64_t mask);
+  // marks the space tiles on the screen
+  void markAnimated();
+
+  // space tiles are stored as read and shown with the current frame
+  char frame(char c) const {
+    if (space_frame && (c == ' ' || c == '*')) {
+      return c == ' ' ? '*' : ' ';
+    }
+    return c;
+  }
+
+  static constexpr char BORDER = '#';
+  static constexpr char COMMENT = ';';
+
+  int map_width = 0;
+  int map_height = 0;
+  int chunks_x = 0;
+  int chunks_y = 0;
+
+  // (chunks_x + 2) x (chunks_y + 2), the outer ring points at walls
+  mutable std::vector<Chunk *> table;
+  mutable std::vector<Chunk *> resident;
+  mutable std::vector<std::unique_ptr<Chunk>> pool;
+  mutable std::vector<Chunk *> free_chunks;
+  mutable size_t unpinned = 0;  // resident chunks that may be dropped
+  mutable Chunk *newest_used = nullptr;
+  mutable Chunk *oldest_used = nullptr;
+  std::vector<Chunk *> changed;
+  std::unique_ptr<Chunk> walls;
+
+  MappedFile world;
+  size_t data_offset = 0;
+  mutable std::vector<bool> verified;
+  std::vector<ChunkData> text_chunks;
+  std::vector<Point> exit_tiles;
+  int chunk_budget = 64;
+  int stream_chunks = 0;  // most chunks one stream() needs at once
+  mutable std::string chunk_error;
+  mutable ChunkStats stats;
+
+  // chunks under the area being drawn, row by row
+  std::vector<const ChunkData *> drawn;
+  int drawn_cx0 = 0;
+  int drawn_cy0 = 0;
+  int drawn_w = 0;
+
+  int space_animation = 0;
+  bool space_frame = false;
+  DirtyRegions *dirty = nullptr;
+  const Camera *camera = nullptr;
+  std::vector<TileChange> *change_log = nullptr;
+};
+
+#endif //MAIN_LEVELMAP_H
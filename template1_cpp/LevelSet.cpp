@@ -0,0 +1,153 @@
+#include "LevelSet.h"
+#include "Game.h"
+
+#include <chrono>
+
+LevelSet::LevelSet(const TileAtlas &a_tiles, int a_screen_width, int a_screen_height) :
+  tiles(a_tiles), screen_width(a_screen_width), screen_height(a_screen_height), level(new LevelMap) {}
+
+LevelSet::~LevelSet() {
+  // the worker uses the tiles, it has to finish first
+  if (worker.valid()) {
+    worker.wait();
+  }
+}
+
+LevelSet::Preloaded LevelSet::load(int n, const std::string &path, bool draw, int budget) const {
+  Preloaded p;
+  p.n = n;
+
+  try {
+    p.map.reset(new LevelMap);
+    if (budget > 0) {
+      p.map->setChunkBudget(budget);
+    }
+    p.start = p.map->read(path.empty() ? levelPath(n) : path);
+
+    if (draw) {
+      // the view the level starts with, see showLevel()
+      Camera view(screen_width, screen_height);
+      DirtyRegions marks(screen_width, screen_height);
+      view.setWorld(p.map->width() * tileSize, p.map->height() * tileSize);
+      view.jump(Rect{p.start.x, p.start.y, tileSize, tileSize});
+
+      p.map->track(marks, view);
+      p.map->stream(view.shown());
+      p.background = Image(screen_width, screen_height, 4);
+      p.map->draw(p.background, tiles);
+      p.view = view.shown();
+    }
+  } catch (std::exception &exc) {
+    p.map.reset();
+    p.error = "level " + std::to_string(n) + ": " + exc.what();
+  }
+  return p;
+}
+
+void LevelSet::preload(int n) {
+  collect();
+  next = Preloaded();
+  error_told = false;
+  // the budget may change on this thread while the worker runs
+  int budget = chunk_budget;
+  worker = std::async(std::launch::async, [this, n, budget]() { return load(n, std::string(), true, budget); });
+}
+
+void LevelSet::collect() {
+  if (worker.valid()) {
+    next = worker.get();
+  }
+}
+
+LevelMap &LevelSet::open(int n, const std::string &path, const std::function<void(const LevelMap &)> &check) {
+  if (n < 1 || n > N_LEVELS) {
+    throw std::runtime_error("No such level");
+  }
+
+  collect();
+  Preloaded p = load(n, path, false, chunk_budget);
+  if (!p.error.empty()) {
+    throw std::runtime_error(p.error);
+  }
+  if (check) {
+    check(*p.map);
+  }
+
+  level = std::move(p.map);
+  level_number = n;
+  starting_pos = p.start;
+  background = Image();
+  if (dirty != nullptr) {
+    level->track(*dirty, *camera);
+  }
+
+  preload(n % N_LEVELS + 1);
+  return *level;
+}
+
+LevelMap &LevelSet::advance(int n) {
+  collect();
+
+  // opened now if the worker failed or preloaded another level
+  Preloaded p;
+  if (next.n == n && next.map) {
+    p = std::move(next);
+    // in case it changed while the level was preloaded
+    if (chunk_budget > 0) {
+      p.map->setChunkBudget(chunk_budget);
+    }
+  } else {
+    p = load(n, std::string(), false, chunk_budget);
+    if (!p.error.empty()) {
+      throw std::runtime_error(p.error);
+    }
+  }
+
+  // the space animation goes on in step with the last level
+  p.map->restart(level->animationTick());
+  if (dirty != nullptr) {
+    p.map->track(*dirty, *camera);
+  }
+
+  level = std::move(p.map);
+  level_number = n;
+  starting_pos = p.start;
+  background = std::move(p.background);
+  background_view = p.view;
+
+  preload(n % N_LEVELS + 1);
+  return *level;
+}
+
+bool LevelSet::takeBackground(Image &screen, const Rect &view) {
+  bool fits = background.Data() != nullptr && background.Width() == screen.Width() &&
+              background.Height() == screen.Height() && background_view.x == view.x &&
+              background_view.y == view.y;
+  if (fits) {
+    std::swap(screen, background);
+  }
+  background = Image();
+  return fits;
+}
+
+std::string LevelSet::preloadError() {
+  if (worker.valid() && worker.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+    collect();
+  }
+  if (next.error.empty() || error_told) {
+    return std::string();
+  }
+  error_told = true;
+  return next.error;
+}
+
+void LevelSet::setChunkBudget(int chunks) {
+  chunk_budget = chunks;
+  level->setChunkBudget(chunks);
+}
+
+void LevelSet::track(DirtyRegions &regions, const Camera &view) {
+  dirty = &regions;
+  camera = &view;
+  level->track(regions, view);
+}
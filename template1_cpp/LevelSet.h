@@ -0,0 +1,88 @@
+#ifndef MAIN_LEVELSET_H
+#define MAIN_LEVELSET_H
+
+#include "Config.h"
+#include "LevelMap.h"
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+// the level being played and the one after it: while a level is played
+// the next one is opened and drawn on a worker thread, so going to
+// the next level only switches maps and screens
+class LevelSet {
+
+public:
+  // levels are drawn for a screen of the given size
+  LevelSet(const TileAtlas &a_tiles, int a_screen_width, int a_screen_height);
+  ~LevelSet();
+
+  LevelSet(const LevelSet &) = delete;
+  LevelSet& operator=(const LevelSet &) = delete;
+
+  // opens level n (from path, or from its usual file) right away
+  // and starts preloading the level after it; check may throw
+  // std::runtime_error to keep the current level instead
+  LevelMap &open(int n, const std::string &path = std::string(),
+                 const std::function<void(const LevelMap &)> &check = nullptr);
+
+  LevelMap &current() { return *level; }
+  int number() const { return level_number; }
+  Point start() const { return starting_pos; }
+
+  // switches to level n as it was loaded, preloaded if it is ready;
+  // if level n can not be opened, std::runtime_error is thrown
+  // and the current level stays
+  LevelMap &advance(int n);
+
+  // swaps the screen with the preloaded picture of the current level
+  // if it was drawn for the given view (in world pixels)
+  bool takeBackground(Image &screen, const Rect &view);
+
+  // why preloading failed, told once; empty if it did not
+  std::string preloadError();
+
+  void setChunkBudget(int chunks);
+  void track(DirtyRegions &regions, const Camera &view);
+
+private:
+  struct Preloaded {
+    int n = 0;
+    std::unique_ptr<LevelMap> map;
+    Point start{0, 0};
+    Image background;
+    Rect view{0, 0, 0, 0};
+    std::string error;
+  };
+
+  // runs on the worker; errors are kept in the result. everything it
+  // reads of this is set once in the constructor, the rest is passed in
+  Preloaded load(int n, const std::string &path, bool draw, int budget) const;
+  void preload(int n);
+  // waits for the worker if it is still busy
+  void collect();
+
+  const TileAtlas &tiles;
+  int screen_width;
+  int screen_height;
+
+  std::unique_ptr<LevelMap> level;
+  int level_number = 0;
+  Point starting_pos{0, 0};
+
+  std::future<Preloaded> worker;
+  Preloaded next;
+  bool error_told = false;
+
+  Image background;
+  Rect background_view{0, 0, 0, 0};
+
+  int chunk_budget = 0;
+  DirtyRegions *dirty = nullptr;
+  const Camera *camera = nullptr;
+};
+
+#endif //MAIN_LEVELSET_H
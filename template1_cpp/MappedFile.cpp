@@ -0,0 +1,117 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &path)
+{
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    throw std::runtime_error("Unable to open file " + path);
+
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+  {
+    CloseHandle(file);
+    throw std::runtime_error("Unable to map an empty file " + path);
+  }
+
+  mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (mapping == nullptr)
+    throw std::runtime_error("Unable to map file " + path);
+
+  bytes = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (bytes == nullptr)
+  {
+    CloseHandle(mapping);
+    mapping = nullptr;
+    throw std::runtime_error("Unable to map file " + path);
+  }
+  length = size_t(file_size.QuadPart);
+}
+
+void MappedFile::close()
+{
+  if (bytes != nullptr)
+    UnmapViewOfFile(bytes);
+  if (mapping != nullptr)
+    CloseHandle(mapping);
+  bytes = nullptr;
+  mapping = nullptr;
+  length = 0;
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &path)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Unable to open file " + path);
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0)
+  {
+    ::close(fd);
+    throw std::runtime_error("Unable to map an empty file " + path);
+  }
+
+  void *p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED)
+    throw std::runtime_error("Unable to map file " + path);
+
+  bytes = (const unsigned char *)p;
+  length = size_t(st.st_size);
+}
+
+void MappedFile::close()
+{
+  if (bytes != nullptr)
+    munmap((void *)bytes, length);
+  bytes = nullptr;
+  length = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+{
+  *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile &&other) noexcept
+{
+  if (this != &other)
+  {
+    close();
+    bytes = other.bytes;
+    length = other.length;
+    other.bytes = nullptr;
+    other.length = 0;
+#ifdef _WIN32
+    mapping = other.mapping;
+    other.mapping = nullptr;
+#endif
+  }
+  return *this;
+}
@@ -0,0 +1,37 @@
+#ifndef MAIN_MAPPEDFILE_H
+#define MAIN_MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+// read-only view of a whole file mapped into memory;
+// pages are read by the OS when they are first touched
+class MappedFile
+{
+public:
+  MappedFile() {}
+  // throws std::runtime_error if the file can not be mapped
+  explicit MappedFile(const std::string &path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile& operator=(const MappedFile &) = delete;
+
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile& operator=(MappedFile &&other) noexcept;
+
+  const unsigned char *data() const { return bytes; }
+  size_t size() const { return length; }
+  bool empty() const { return bytes == nullptr; }
+
+private:
+  void close();
+
+  const unsigned char *bytes = nullptr;
+  size_t length = 0;
+#ifdef _WIN32
+  void *mapping = nullptr;
+#endif
+};
+
+#endif //MAIN_MAPPEDFILE_H
@@ -34,16 +34,23 @@ void Player::ProcessInput(MovementDir dir)
   }
 }
 
-void Player::Draw(Image &screen)
+void Player::interpolate(double alpha)
+{
+  draw_coords.x = tick_coords.x + int((coords.x - tick_coords.x) * alpha);
+  draw_coords.y = tick_coords.y + int((coords.y - tick_coords.y) * alpha);
+  drawn_dir = dir;
+}
+
+void Player::Draw(Image &screen, Point origin)
 {
 
   if (dir == MovementDir::LEFT) {
-    left.set_x(coords.x);
-    left.set_y(coords.y);
+    left.set_x(draw_coords.x - origin.x);
+    left.set_y(draw_coords.y - origin.y);
     left.Draw(screen);
   } else {
-    right.set_x(coords.x);
-    right.set_y(coords.y);
+    right.set_x(draw_coords.x - origin.x);
+    right.set_y(draw_coords.y - origin.y);
     right.Draw(screen);
   }
 
@@ -21,25 +21,48 @@ enum class playerStatus {
   OK, DEAD, ESCAPED
 };
 
-struct Player
+// what the simulation changes in a player
+struct PlayerState
 {
-  explicit Player(Point pos, Image &l, Image &r) :
-                 coords(pos), old_coords(coords) {
+  Point coords;
+  Point old_coords;
+  Point tick_coords;
+  MovementDir dir;
+  playerStatus status;
+  int smash_cooldown;
+};
 
-    left = l;
-    right = r;
+struct Player
+{
+  // takes over the sprites
+  explicit Player(Point pos, Image &&l, Image &&r) :
+                 coords(pos), old_coords(coords), tick_coords(coords), draw_coords(coords),
+                 left(std::move(l)), right(std::move(r)) {
   };
 
   bool Moved() const;
   void ProcessInput(MovementDir dir);
-  void Draw(Image &screen);
+  // origin is the world position of the screen's corner
+  void Draw(Image &screen, Point origin);
 
-  Point getCoords() { return coords; }
+  Point getCoords() const { return coords; }
+  // where the sprite is drawn
+  Rect bounds() const { return Rect{draw_coords.x, draw_coords.y, tileSize, tileSize}; }
   int getSpeed() { return move_speed; }
   void setPos(int x, int y) {
     coords.x = x;
     coords.y = y;
+    tick_coords = coords;
+    draw_coords = coords;
   }
+
+  // remembers the position at the start of a simulation tick
+  void beginTick() { tick_coords = coords; }
+  // moves the sprite between the positions before and after
+  // the last tick, alpha = 1 puts it where the player is
+  void interpolate(double alpha);
+  // the sprite faces another way than when it was last placed
+  bool turned() const { return dir != drawn_dir; }
   void setOldPos(int x, int y) {
     old_coords.x = x;
     old_coords.y = y;
@@ -48,16 +71,33 @@ struct Player
     dir = new_dir;
   }
 
+  PlayerState state() const {
+    return PlayerState{coords, old_coords, tick_coords, dir, status, smash_cooldown};
+  }
+  // the sprite is put where the player is
+  void setState(const PlayerState &s) {
+    coords = s.coords;
+    old_coords = s.old_coords;
+    tick_coords = s.tick_coords;
+    draw_coords = s.coords;
+    dir = s.dir;
+    status = s.status;
+    smash_cooldown = s.smash_cooldown;
+  }
+
   playerStatus status = playerStatus::OK;
   int smash_cooldown = 0;
 
 private:
   Point coords {.x = 10, .y = 10};
   Point old_coords {.x = 10, .y = 10};
+  Point tick_coords {.x = 10, .y = 10};
+  Point draw_coords {.x = 10, .y = 10};
   Pixel color {.r = 255, .g = 0, .b = 0, .a = 255};
   int move_speed = 4;
   Image left, right;
   MovementDir dir = MovementDir::LEFT;
+  MovementDir drawn_dir = MovementDir::LEFT;
 };
 
 #endif //MAIN_PLAYER_H
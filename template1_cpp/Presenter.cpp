@@ -0,0 +1,153 @@
+#include "Presenter.h"
+
+#include <cstring>
+
+#define GLFW_DLL
+#include <GLFW/glfw3.h>
+
+Presenter::Presenter(int a_width, int a_height) : width(a_width), height(a_height)
+{
+  glGenTextures(1, &texture); GL_CHECK_ERRORS;
+  glBindTexture(GL_TEXTURE_2D, texture); GL_CHECK_ERRORS;
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); GL_CHECK_ERRORS;
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST); GL_CHECK_ERRORS;
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); GL_CHECK_ERRORS;
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); GL_CHECK_ERRORS;
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr); GL_CHECK_ERRORS;
+
+  // rows of Pixel are tightly packed
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4); GL_CHECK_ERRORS;
+
+  use_pbo = GLAD_GL_VERSION_2_1;
+  if (use_pbo)
+  {
+    glGenBuffers(PBO_RING, pbo); GL_CHECK_ERRORS;
+    for (int i = 0; i < PBO_RING; ++i)
+    {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo[i]); GL_CHECK_ERRORS;
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, width * height * sizeof(Pixel), nullptr, GL_STREAM_DRAW); GL_CHECK_ERRORS;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); GL_CHECK_ERRORS;
+  }
+
+  invalidateAll();
+}
+
+Presenter::~Presenter()
+{
+  // the context may already be gone with glfwTerminate()
+  if (glfwGetCurrentContext() == nullptr)
+    return;
+
+  if (use_pbo)
+    glDeleteBuffers(PBO_RING, pbo);
+  glDeleteTextures(1, &texture);
+}
+
+void Presenter::invalidate(const Rect &r)
+{
+  Rect visible = Intersect(r, Rect{0, 0, width, height});
+  if (!visible.Empty())
+    dirty.push_back(visible);
+}
+
+void Presenter::invalidateAll()
+{
+  dirty.clear();
+  dirty.push_back(Rect{0, 0, width, height});
+}
+
+void Presenter::uploadDirect(const Image &screen)
+{
+  // the texture is updated straight from client memory,
+  // rows of the rectangle are picked out of the whole screen
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, screen.Width());
+
+  for (const Rect &r : dirty)
+  {
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, r.x);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, r.y);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.w, r.h, GL_RGBA, GL_UNSIGNED_BYTE, screen.Data()); GL_CHECK_ERRORS;
+    last_upload += r.w * r.h * sizeof(Pixel);
+  }
+
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+  glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+}
+
+void Presenter::uploadThroughPBO(const Image &screen)
+{
+  size_t total = 0;
+  for (const Rect &r : dirty)
+    total += r.w * r.h;
+
+  // overlapping rectangles may add up to more than the screen
+  if (total > size_t(width * height))
+    invalidateAll();
+
+  // the buffers take turns, the one mapped here was last read by the
+  // upload PBO_RING frames ago; nothing checks that it is done, the
+  // driver makes glMapBuffer wait if it is not (and the frame stalls)
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo[next_pbo]); GL_CHECK_ERRORS;
+  auto *staging = (Pixel *) glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY); GL_CHECK_ERRORS;
+
+  if (staging == nullptr)
+  {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    uploadDirect(screen);
+    return;
+  }
+
+  // rectangles are packed one after another, each one row by row
+  size_t offset = 0;
+  offsets.clear();
+  for (const Rect &r : dirty)
+  {
+    offsets.push_back(offset);
+    for (int y = r.y; y < r.y + r.h; ++y)
+    {
+      memcpy(staging + offset, screen.Data() + r.x + y * screen.Width(), r.w * sizeof(Pixel));
+      offset += r.w;
+    }
+  }
+
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER); GL_CHECK_ERRORS;
+
+  for (size_t i = 0; i < dirty.size(); ++i)
+  {
+    const Rect &r = dirty[i];
+    glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.w, r.h, GL_RGBA, GL_UNSIGNED_BYTE,
+                    (const void *) (offsets[i] * sizeof(Pixel))); GL_CHECK_ERRORS;
+  }
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); GL_CHECK_ERRORS;
+
+  last_upload = offset * sizeof(Pixel);
+  next_pbo = (next_pbo + 1) % PBO_RING;
+}
+
+void Presenter::present(const Image &screen)
+{
+  glBindTexture(GL_TEXTURE_2D, texture); GL_CHECK_ERRORS;
+
+  last_upload = 0;
+  if (!dirty.empty())
+  {
+    if (use_pbo)
+      uploadThroughPBO(screen);
+    else
+      uploadDirect(screen);
+    dirty.clear();
+  }
+
+  // row 0 of the screen is the bottom one, as with glDrawPixels
+  glEnable(GL_TEXTURE_2D);
+  glBegin(GL_QUADS);
+    glTexCoord2f(0.0f, 0.0f); glVertex2f(-1.0f, -1.0f);
+    glTexCoord2f(1.0f, 0.0f); glVertex2f( 1.0f, -1.0f);
+    glTexCoord2f(1.0f, 1.0f); glVertex2f( 1.0f,  1.0f);
+    glTexCoord2f(0.0f, 1.0f); glVertex2f(-1.0f,  1.0f);
+  glEnd(); GL_CHECK_ERRORS;
+  glDisable(GL_TEXTURE_2D);
+}
@@ -0,0 +1,52 @@
+#ifndef MAIN_PRESENTER_H
+#define MAIN_PRESENTER_H
+
+#include "common.h"
+#include "Image.h"
+
+#include <vector>
+
+// shows the screen image through a persistent texture drawn as a
+// fullscreen quad; only the rectangles marked with invalidate() are
+// uploaded, through a ring of pixel unpack buffers when GL 2.1 is there
+//
+// sticks to the compatibility profile basics (immediate mode quad,
+// glMapBuffer), so it also runs on Mesa llvmpipe (LIBGL_ALWAYS_SOFTWARE=1)
+class Presenter
+{
+public:
+  static constexpr int PBO_RING = 3;
+
+  // needs a current OpenGL context
+  Presenter(int a_width, int a_height);
+  ~Presenter();
+
+  Presenter(const Presenter &) = delete;
+  Presenter& operator=(const Presenter &) = delete;
+
+  void invalidate(const Rect &r);
+  void invalidateAll();
+
+  // uploads what changed since the last call and draws the quad
+  void present(const Image &screen);
+
+  // bytes sent to the texture by the last present()
+  size_t lastUploadBytes() const { return last_upload; }
+
+private:
+  void uploadDirect(const Image &screen);
+  void uploadThroughPBO(const Image &screen);
+
+  int width;
+  int height;
+  GLuint texture = 0;
+  GLuint pbo[PBO_RING] = {};
+  int next_pbo = 0;
+  bool use_pbo = false;
+
+  std::vector<Rect> dirty;
+  std::vector<size_t> offsets;
+  size_t last_upload = 0;
+};
+
+#endif //MAIN_PRESENTER_H
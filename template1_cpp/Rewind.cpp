@@ -0,0 +1,109 @@
+#include "Rewind.h"
+
+#include <algorithm>
+
+Rewind::Rewind(size_t max_changes) : records(REWIND_SECONDS * TICKS_PER_SECOND + 1), changes(max_changes) {}
+
+void Rewind::keep(const LevelMap &Level, const Player &player) {
+  TickRecord &r = at(now);
+  r.player = player.state();
+  r.animation_tick = Level.animationTick();
+  r.animation_frame = Level.animationFrame();
+
+  if (now % REWIND_KEYFRAME_TICKS == 0) {
+    keyframes.push_back(Keyframe{now, Level.snapshot()});
+  }
+}
+
+void Rewind::reset(LevelMap &Level, const Player &player) {
+  keyframes.clear();
+  pending.clear();
+  first = now = 0;
+  at(now).changes_end = 0;
+  keep(Level, player);
+
+  Level.recordChanges(&pending);
+}
+
+void Rewind::record(const LevelMap &Level, const Player &player) {
+  uint64_t changes_end = at(now).changes_end;
+  now++;
+
+  // the oldest ticks make room for the new one and its changes
+  if (now - first >= records.size()) {
+    first++;
+  }
+  while (first < now - 1 && changes_end + pending.size() - at(first).changes_end > changes.size()) {
+    first++;
+  }
+  if (changes_end + pending.size() - at(first).changes_end > changes.size()) {
+    // more tiles at once than the ring holds, nothing before can be undone
+    first = now;
+    pending.clear();
+  }
+  while (!keyframes.empty() && keyframes.front().tick < first) {
+    keyframes.pop_front();
+  }
+
+  for (const TileChange &c : pending) {
+    changes[changes_end++ % changes.size()] = c;
+  }
+  pending.clear();
+
+  at(now).changes_end = changes_end;
+  keep(Level, player);
+}
+
+int Rewind::back(int n, LevelMap &Level, Player &player, const Camera &camera, DirtyRegions &dirty) {
+  uint64_t target = now - std::min<uint64_t>(uint64_t(n), now - first);
+  if (target == now) {
+    return 0;
+  }
+
+  // the tiles are set back without being logged again
+  Level.recordChanges(nullptr);
+  Level.setAnimation(at(target).animation_tick, at(target).animation_frame);
+
+  const Keyframe *key = nullptr;
+  if (now - target > REWIND_KEYFRAME_TICKS) {
+    for (const Keyframe &k : keyframes) {
+      if (k.tick <= target) {
+        key = &k;
+      }
+    }
+  }
+
+  if (key != nullptr) {
+    Level.restore(key->level);
+    for (uint64_t i = at(key->tick).changes_end; i < at(target).changes_end; ++i) {
+      Level.set(change(i).x, change(i).y, change(i).after);
+    }
+  } else {
+    for (uint64_t i = at(now).changes_end; i > at(target).changes_end; --i) {
+      Level.set(change(i - 1).x, change(i - 1).y, change(i - 1).before);
+    }
+  }
+
+  Rect before = player.bounds();
+  player.setState(at(target).player);
+  dirty.add(camera.toScreen(before));
+  dirty.add(camera.toScreen(player.bounds()));
+
+  while (!keyframes.empty() && keyframes.back().tick > target) {
+    keyframes.pop_back();
+  }
+  int went = int(now - target);
+  now = target;
+  pending.clear();
+  Level.recordChanges(&pending);
+  return went;
+}
+
+size_t Rewind::memoryBytes() const {
+  size_t bytes = records.size() * sizeof(TickRecord) +
+                 (changes.size() + pending.capacity()) * sizeof(TileChange);
+  for (const Keyframe &k : keyframes) {
+    bytes += sizeof(Keyframe) + k.level.bytes();
+  }
+  return bytes;
+}
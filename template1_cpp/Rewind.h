@@ -0,0 +1,75 @@
+#ifndef MAIN_REWIND_H
+#define MAIN_REWIND_H
+
+#include "Config.h"
+#include "LevelMap.h"
+#include "Player.h"
+#include "Camera.h"
+#include "DirtyRegions.h"
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// how far back the game can go, and how fast while the key is held
+constexpr int REWIND_SECONDS = 10;
+constexpr int REWIND_SPEED = 2;          // ticks back per tick
+constexpr int REWIND_KEYFRAME_TICKS = 60;
+constexpr size_t REWIND_MAX_CHANGES = 1 << 14;
+
+// the last REWIND_SECONDS of a level: after every tick the player's
+// state and the tiles set during the tick are kept in rings, and every
+// REWIND_KEYFRAME_TICKS ticks a snapshot of the level. going back
+// undoes the tile changes one by one, or for a long way restores the
+// keyframe before the target and redoes the changes after it; either
+// way only the tiles that change are repainted.
+// the oldest ticks are dropped when either ring is full
+class Rewind {
+
+public:
+  // keeps at most max_changes tile changes
+  explicit Rewind(size_t max_changes = REWIND_MAX_CHANGES);
+
+  // history starts again from here (new level, restart);
+  // tiles set on the level are logged from now on
+  void reset(LevelMap &Level, const Player &player);
+
+  // after every simulated tick
+  void record(const LevelMap &Level, const Player &player);
+
+  // goes back up to n ticks; returns how many it went
+  int back(int n, LevelMap &Level, Player &player, const Camera &camera, DirtyRegions &dirty);
+
+  // ticks that can be undone
+  int available() const { return int(now - first); }
+
+  // memory held, counting keyframe tiles as if nothing shared them
+  size_t memoryBytes() const;
+
+private:
+  struct TickRecord {
+    PlayerState player;
+    int animation_tick;
+    bool animation_frame;
+    uint64_t changes_end;   // changes of this and earlier ticks
+  };
+
+  struct Keyframe {
+    uint64_t tick;
+    LevelMap::Snapshot level;
+  };
+
+  TickRecord &at(uint64_t tick) { return records[tick % records.size()]; }
+  const TileChange &change(uint64_t i) const { return changes[i % changes.size()]; }
+  void keep(const LevelMap &Level, const Player &player);
+
+  std::vector<TickRecord> records;   // ring, by tick
+  std::vector<TileChange> changes;   // ring, by change number
+  std::vector<TileChange> pending;   // set during the current tick
+  std::deque<Keyframe> keyframes;
+
+  uint64_t first = 0;                // oldest tick that can be gone back to
+  uint64_t now = 0;
+};
+
+#endif //MAIN_REWIND_H
@@ -0,0 +1,277 @@
+#include "SaveGame.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+static const char MAGIC[4] = {'E', 'C', 'S', 'V'};
+static const uint32_t VERSION = 1;
+static const size_t HEADER_BYTES = 20;
+static const char TILE_SYMBOLS[] = " *.#%bx@";
+
+// FNV-1a
+static const uint64_t FNV_PRIME = 1099511628211ull;
+static const uint64_t FNV_OFFSET = 14695981039346656037ull;
+
+static uint64_t checksum(const uint8_t *data, size_t size)
+{
+  uint64_t hash = FNV_OFFSET;
+  for (size_t i = 0; i < size; ++i)
+    hash = (hash ^ data[i]) * FNV_PRIME;
+  return hash;
+}
+
+static void putU16(std::vector<uint8_t> &out, uint32_t v)
+{
+  out.push_back(uint8_t(v));
+  out.push_back(uint8_t(v >> 8));
+}
+
+static void putU32(std::vector<uint8_t> &out, uint32_t v)
+{
+  putU16(out, v);
+  putU16(out, v >> 16);
+}
+
+static void putPoint(std::vector<uint8_t> &out, Point p)
+{
+  putU32(out, uint32_t(p.x));
+  putU32(out, uint32_t(p.y));
+}
+
+SaveState captureGame(int level, const LevelMap &Level, const Player &player)
+{
+  SaveState state;
+  state.level = level;
+  state.player = player.state();
+  state.animation_tick = Level.animationTick();
+  state.animation_frame = Level.animationFrame();
+  Level.changedTiles(state.tiles);
+  return state;
+}
+
+void writeSave(const std::string &path, const SaveState &state)
+{
+  std::vector<uint8_t> data(HEADER_BYTES);
+  data.reserve(HEADER_BYTES + 48 + state.tiles.size() * 5);
+
+  putU32(data, uint32_t(state.level));
+  putPoint(data, state.player.coords);
+  putPoint(data, state.player.old_coords);
+  putPoint(data, state.player.tick_coords);
+  data.push_back(uint8_t(state.player.dir));
+  data.push_back(uint8_t(state.player.status));
+  putU32(data, uint32_t(state.player.smash_cooldown));
+  putU32(data, uint32_t(state.animation_tick));
+  data.push_back(state.animation_frame);
+
+  putU32(data, uint32_t(state.tiles.size()));
+  for (const TileChange &t : state.tiles)
+  {
+    putU16(data, uint32_t(t.x));
+    putU16(data, uint32_t(t.y));
+    data.push_back(uint8_t(t.after));
+  }
+
+  // the header goes in front of the finished payload
+  std::vector<uint8_t> header;
+  header.insert(header.end(), MAGIC, MAGIC + sizeof(MAGIC));
+  putU32(header, VERSION);
+  putU32(header, uint32_t(data.size() - HEADER_BYTES));
+  uint64_t sum = checksum(data.data() + HEADER_BYTES, data.size() - HEADER_BYTES);
+  putU32(header, uint32_t(sum));
+  putU32(header, uint32_t(sum >> 32));
+  std::copy(header.begin(), header.end(), data.begin());
+
+  // a crash while saving leaves the last save as it was; each write
+  // has a file of its own, two of them never write into one
+  static std::atomic<unsigned> writes{0};
+  std::string temporary = path + "." + std::to_string(writes++) + "-" +
+                          std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".tmp";
+  FILE *f = fopen(temporary.c_str(), "wb");
+  if (f == nullptr)
+    throw std::runtime_error("Unable to open file " + temporary);
+
+  bool written = fwrite(data.data(), 1, data.size(), f) == data.size();
+  if (fclose(f) != 0 || !written)
+  {
+    std::remove(temporary.c_str());
+    throw std::runtime_error("Unable to write file " + temporary);
+  }
+
+#ifdef _WIN32
+  std::remove(path.c_str());
+#endif
+  if (std::rename(temporary.c_str(), path.c_str()) != 0)
+    throw std::runtime_error("Unable to replace " + path);
+}
+
+SaveState readSave(const std::string &path)
+{
+  FILE *f = fopen(path.c_str(), "rb");
+  if (f == nullptr)
+    throw std::runtime_error("Unable to open file " + path);
+
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  std::vector<uint8_t> data(size > 0 ? size_t(size) : 0);
+  bool read = fread(data.data(), 1, data.size(), f) == data.size();
+  fclose(f);
+  if (!read)
+    throw std::runtime_error("Unable to read file " + path);
+
+  size_t pos = 0;
+  auto need = [&](size_t bytes) {
+    if (pos + bytes > data.size())
+      throw std::runtime_error("Save is truncated: " + path);
+  };
+  auto getU8 = [&]() {
+    need(1);
+    return data[pos++];
+  };
+  auto getU16 = [&]() {
+    need(2);
+    uint32_t v = uint32_t(data[pos]) | uint32_t(data[pos + 1]) << 8;
+    pos += 2;
+    return v;
+  };
+  auto getU32 = [&]() {
+    uint32_t lo = getU16();
+    return lo | getU16() << 16;
+  };
+  auto getPoint = [&]() {
+    int x = int(getU32());
+    return Point{x, int(getU32())};
+  };
+
+  need(HEADER_BYTES);
+  if (!std::equal(MAGIC, MAGIC + sizeof(MAGIC), data.begin()))
+    throw std::runtime_error("Not a save: " + path);
+  pos += sizeof(MAGIC);
+
+  if (getU32() != VERSION)
+    throw std::runtime_error("Unsupported save version: " + path);
+  uint32_t payload = getU32();
+  uint64_t sum = getU32();
+  sum |= uint64_t(getU32()) << 32;
+  need(payload);
+  if (payload != data.size() - HEADER_BYTES || checksum(data.data() + HEADER_BYTES, payload) != sum)
+    throw std::runtime_error("Save is corrupt: " + path);
+
+  SaveState state;
+  state.level = int(getU32());
+  state.player.coords = getPoint();
+  state.player.old_coords = getPoint();
+  state.player.tick_coords = getPoint();
+  uint8_t dir = getU8(), status = getU8();
+  state.player.smash_cooldown = int(getU32());
+  state.animation_tick = int(getU32());
+  state.animation_frame = getU8() != 0;
+
+  if (state.level < 1 || state.level > N_LEVELS || dir > uint8_t(MovementDir::RIGHT) ||
+      status > uint8_t(playerStatus::ESCAPED) || state.animation_tick < 0 ||
+      state.animation_tick >= ANIMATION_FREQUENCY)
+    throw std::runtime_error("Save is corrupt: " + path);
+  state.player.dir = MovementDir(dir);
+  state.player.status = playerStatus(status);
+
+  uint32_t n = getU32();
+  need(size_t(n) * 5);
+  state.tiles.resize(n);
+  for (TileChange &t : state.tiles)
+  {
+    t.x = int(getU16());
+    t.y = int(getU16());
+    t.before = 0;
+    t.after = char(getU8());
+  }
+
+  return state;
+}
+
+// the level file may have changed since the save,
+// nothing is changed unless every tile fits
+static void checkFits(const SaveState &state, const LevelMap &Level)
+{
+  for (const TileChange &t : state.tiles)
+    if (t.x >= Level.width() || t.y >= Level.height() || t.after == 0 ||
+        std::strchr(TILE_SYMBOLS, t.after) == nullptr)
+      throw std::runtime_error("Save does not fit level " + std::to_string(state.level));
+}
+
+LevelMap &applySave(const SaveState &state, LevelSet &levels, Player &player, Camera &camera, DirtyRegions &dirty)
+{
+  // the level being played only has to go back to its start;
+  // another one is checked before the game switches to it
+  LevelMap &Level = levels.number() == state.level
+                        ? levels.current()
+                        : levels.open(state.level, std::string(), [&](const LevelMap &m) { checkFits(state, m); });
+  checkFits(state, Level);
+
+  Level.restart(state.animation_tick);
+  Level.setAnimation(state.animation_tick, state.animation_frame);
+  for (const TileChange &t : state.tiles)
+    Level.set(t.x, t.y, t.after);
+
+  player.setState(state.player);
+  showLevel(Level, player, camera);
+  dirty.addAll();
+  return Level;
+}
+
+Autosave::Autosave(const std::string &a_path, double a_interval) : path(a_path), interval(a_interval) {}
+
+Autosave::~Autosave()
+{
+  if (worker.valid())
+    worker.wait();
+}
+
+void Autosave::save(const std::string &file, int level, const LevelMap &Level, const Player &player)
+{
+  if (worker.valid())
+    failure = worker.get();
+  writeSave(file, captureGame(level, Level, player));
+}
+
+bool Autosave::update(double now, int level, const LevelMap &Level, const Player &player)
+{
+  if (last < 0)
+    last = now;
+  if (now - last < interval)
+    return false;
+  if (worker.valid() && worker.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    return false;
+
+  if (worker.valid())
+    failure = worker.get();
+
+  last = now;
+  n_saved++;
+  SaveState state = captureGame(level, Level, player);
+  std::string file = path;
+  worker = std::async(std::launch::async, [file](const SaveState &s) {
+    try {
+      writeSave(file, s);
+    } catch (std::runtime_error &exc) {
+      return std::string(exc.what());
+    }
+    return std::string();
+  }, std::move(state));
+  return true;
+}
+
+std::string Autosave::error()
+{
+  if (worker.valid() && worker.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    failure = worker.get();
+
+  std::string told;
+  told.swap(failure);
+  return told;
+}
@@ -0,0 +1,83 @@
+#ifndef MAIN_SAVEGAME_H
+#define MAIN_SAVEGAME_H
+
+#include "Game.h"
+
+#include <future>
+#include <string>
+#include <vector>
+
+// save file, little endian:
+//   "ECSV", version, payload size (uint32 each), payload checksum (uint64)
+//   payload:
+//     level number (uint32)
+//     player: position, position before the move, position at the start
+//             of the tick (int32 x, y each), direction, status (uint8 each),
+//             smash cooldown (int32)
+//     space animation tick (int32) and frame (uint8)
+//     number of changed tiles (uint32), then x, y (uint16 each)
+//     and the symbol of every tile that differs from the level file
+//
+// the whole file is written with one call to a temporary file that then
+// replaces the old save, and read with one call before it is checked
+
+constexpr double AUTOSAVE_SECONDS = 5.0;
+
+// everything needed to continue a game
+struct SaveState
+{
+  int level = 1;
+  PlayerState player;
+  int animation_tick = 0;
+  bool animation_frame = false;
+  std::vector<TileChange> tiles;   // only x, y and after are used
+};
+
+// cheap enough for every frame: costs as much as the changed chunks
+SaveState captureGame(int level, const LevelMap &Level, const Player &player);
+
+// throw std::runtime_error if the file can not be written or read,
+// or is not a valid save
+void writeSave(const std::string &path, const SaveState &state);
+SaveState readSave(const std::string &path);
+
+// opens the saved level, unless it is the current one, and puts
+// the game as it was saved; returns the level. a save that does not
+// fit its level throws std::runtime_error and changes nothing
+LevelMap &applySave(const SaveState &state, LevelSet &levels, Player &player, Camera &camera, DirtyRegions &dirty);
+
+// saves the game every AUTOSAVE_SECONDS to a file of its own; the
+// state is captured on the caller's thread and written on a worker, a
+// save still being written makes the next one wait for the next frame.
+// every save of the game goes through here, so two never overlap
+class Autosave
+{
+public:
+  explicit Autosave(const std::string &a_path, double a_interval = AUTOSAVE_SECONDS);
+  ~Autosave();
+
+  Autosave(const Autosave &) = delete;
+  Autosave& operator=(const Autosave &) = delete;
+
+  // writes the game to file on this thread, after the autosave being
+  // written; throws std::runtime_error if it can not be written
+  void save(const std::string &file, int level, const LevelMap &Level, const Player &player);
+
+  // now is in seconds; returns true if a save was started
+  bool update(double now, int level, const LevelMap &Level, const Player &player);
+
+  // why the last save failed, told once; empty if it did not
+  std::string error();
+
+  long saved() const { return n_saved; }
+
+private:
+  std::string path;
+  double interval;
+  double last = -1;
+  std::future<std::string> worker;
+  std::string failure;
+  long n_saved = 0;
+};
+
+#endif //MAIN_SAVEGAME_H
@@ -0,0 +1,1097 @@
+#include "SelfTest.h"
+#include "Allocations.h"
+#include "Blend.h"
+#include "FramePipeline.h"
+#include "Game.h"
+#include "InputRecorder.h"
+#include "InputQueue.h"
+#include "JobSystem.h"
+#include "LevelMap.h"
+#include "Rewind.h"
+#include "SaveGame.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+static bool samePixel(Pixel a, Pixel b)
+{
+  return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+static std::ostream &operator<<(std::ostream &out, Pixel p)
+{
+  return out << "(" << int(p.r) << ", " << int(p.g) << ", " << int(p.b) << ", " << int(p.a) << ")";
+}
+
+// prints what is wrong unless ok, and the test has not passed then
+static void expect(bool &passed, bool ok, const std::string &what)
+{
+  if (!ok)
+  {
+    std::cout << what << std::endl;
+    passed = false;
+  }
+}
+
+// the same numbers on every run
+struct Random
+{
+  explicit Random(uint32_t a_seed) : seed(a_seed) {}
+
+  // 0 .. range - 1
+  int below(int range)
+  {
+    seed = seed * 1664525u + 1013904223u;
+    return int((seed >> 8) % uint32_t(range));
+  }
+
+  uint8_t byte() { return uint8_t(below(256)); }
+
+private:
+  uint32_t seed;
+};
+
+// blends src over dst with a kernel and compares every pixel with mix()
+static bool blendMatches(const BlendKernel &kernel, const std::vector<Pixel> &dst, const std::vector<Pixel> &src)
+{
+  std::vector<Pixel> out = dst;
+  kernel.row(out.data(), src.data(), int(src.size()));
+
+  for (size_t i = 0; i < src.size(); ++i)
+  {
+    Pixel old = dst[i];
+    Pixel expected = mix(old, src[i]);
+    if (!samePixel(out[i], expected))
+    {
+      std::cout << kernel.name << ": " << src[i] << " over " << dst[i] << " gives " << out[i]
+                << ", mix() gives " << expected << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// every kernel against mix() for all 256^3 source, destination and
+// alpha values of a channel, then for rows of mixed alphas
+static bool checkBlend()
+{
+  std::vector<Pixel> dst(256), src(256);
+
+  for (const BlendKernel &kernel : BlendKernels())
+  {
+    for (int a = 0; a < 256; ++a)
+    {
+      for (int s = 0; s < 256; ++s)
+      {
+        // r and b see every pair of values, g mixes them up
+        for (int d = 0; d < 256; ++d)
+        {
+          src[d] = Pixel{uint8_t(s), uint8_t(s * 7 + d), uint8_t(255 - s), uint8_t(a)};
+          dst[d] = Pixel{uint8_t(d), uint8_t(d * 13 + s), uint8_t(255 - d), uint8_t(d)};
+        }
+        if (!blendMatches(kernel, dst, src))
+          return false;
+      }
+    }
+
+    // neighbours with different alphas share a vector, some of them
+    // taking the mix() path, at every offset of a row
+    Random random(1);
+    for (int row = 0; row < 20000; ++row)
+    {
+      int count = 1 + row % 37;
+      dst.resize(count);
+      src.resize(count);
+      for (int i = 0; i < count; ++i)
+      {
+        uint8_t v = random.byte();
+        uint8_t alpha = v < 64 ? 0 : v < 128 ? 255 : random.byte();
+        src[i] = Pixel{random.byte(), random.byte(), random.byte(), alpha};
+        dst[i] = Pixel{random.byte(), random.byte(), random.byte(), random.byte()};
+      }
+      if (!blendMatches(kernel, dst, src))
+        return false;
+    }
+    dst.resize(256);
+    src.resize(256);
+  }
+  return true;
+}
+
+// allocations made building the atlas and loading every tile into it
+// on this thread: the atlas pixels are allocated once, the pixels of
+// a tile image come from stbi_load (malloc), are moved from image to
+// image and copied into the atlas, so loading allocates nothing
+static const long ATLAS_ALLOCATIONS = 1;
+static const long TILE_LOADING_ALLOCATIONS = 0;
+
+static bool checkTileAllocations()
+{
+  long before = allocationCount();
+  TileAtlas tiles;
+  long atlas = allocationCount() - before;
+
+  before = allocationCount();
+  size_t bytes_before = allocatedBytes();
+  loadTiles(tiles);
+  long loading = allocationCount() - before;
+
+  if (atlas > ATLAS_ALLOCATIONS || loading > TILE_LOADING_ALLOCATIONS)
+  {
+    std::cout << "atlas: " << atlas << " allocations (expected " << ATLAS_ALLOCATIONS << "), tile loading: "
+              << loading << " allocations of " << allocatedBytes() - bytes_before << " bytes (expected "
+              << TILE_LOADING_ALLOCATIONS << ")" << std::endl;
+  }
+
+  return atlas <= ATLAS_ALLOCATIONS && loading <= TILE_LOADING_ALLOCATIONS;
+}
+
+static void writeFile(const std::string &path, const std::string &bytes)
+{
+  std::ofstream out(path, std::ios::binary);
+  out.write(bytes.data(), bytes.size());
+  if (!out)
+    throw std::runtime_error("Unable to write " + path);
+}
+
+static std::string readFile(const std::string &path)
+{
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// the error a text map gives when it is read, empty if it is read
+static std::string readError(LevelMap &map, const std::string &path, const std::string &text)
+{
+  writeFile(path, text);
+  try {
+    map.read(path);
+  } catch (std::runtime_error &exc) {
+    return exc.what();
+  }
+  return std::string();
+}
+
+// the messages of the text map parser, and what it skips and accepts;
+// bad symbols are put past the first sixteen of a row as well, where
+// they are found sixteen at a time
+static bool checkParser()
+{
+  const std::string path = "selftest_parser.txt";
+  bool passed = true;
+  auto expectError = [&](const std::string &text, const std::string &message) {
+    LevelMap map;
+    std::string got = readError(map, path, text);
+    expect(passed, got == message, "\"" + got + "\" instead of \"" + message + "\"");
+  };
+
+  expectError("; a comment\n#####\n\n##q##\n", "line 4, column 3: unknown tile 'q'");
+  expectError(std::string(40, '.') + "\n" + std::string(36, '.') + "q..\n",
+              "line 2, column 37: unknown tile 'q'");
+  expectError("#\t#\n", "line 1, column 2: unknown tile code 9");
+  expectError("#####\n#####\n####\n", "line 3, column 5: the row has 4 tiles, the first one (line 1) has 5");
+  expectError("#####\n######\n", "line 2, column 6: the row has 6 tiles, the first one (line 1) has 5");
+  expectError(std::string(MAX_MAP_TILES + 1, '.') + "\n", "line 1: the map is too big");
+  expectError("; only a comment\n\n", "The map is empty");
+
+  // the first line is the bottom row, the player stands on the floor
+  LevelMap map;
+  std::string got = readError(map, path, "; a comment\r\n\r\n#.@x\r\n;\r\n%b *\r\n");
+  expect(passed, got.empty(), "comments, empty lines and CRLF endings give \"" + got + "\"");
+  if (got.empty())
+  {
+    Point start = map.read(path);
+    expect(passed, map.width() == 4 && map.height() == 2, "the map is not 4x2 tiles");
+    expect(passed, start.x == 2 * tileSize && start.y == 0, "the player does not start on its tile");
+    std::string tiles;
+    for (int y = 0; y < 2; ++y)
+      for (int x = 0; x < 4; ++x)
+        tiles += map.get(x, y);
+    expect(passed, tiles == "#..x%b *", "the tiles read are \"" + tiles + "\"");
+  }
+
+  std::remove(path.c_str());
+  return passed;
+}
+
+// walks a window over a world file opened with a budget of one chunk,
+// changing a few tiles at the bottom, and compares every tile with the
+// text map it was made from, changed the same way; then breaks
+// one chunk of the file, which has to read as walls without throwing
+static bool checkChunks()
+{
+  const int width = 1000, height = 300;
+  const std::string text_path = "selftest_map.txt", world_path = "selftest_map.lvl";
+
+  bool passed = true;
+  try {
+    writeFile(text_path, generateMap(width, height));
+    LevelMap reference;
+    Point start = reference.read(text_path);
+    reference.write(world_path, start);
+
+    LevelMap streamed;
+    streamed.setChunkBudget(1);
+    streamed.read(world_path);
+
+    const int view_w = WINDOW_WIDTH / tileSize, view_h = WINDOW_HEIGHT / tileSize;
+    for (int vy = 0; vy + view_h <= height && passed; vy += 7)
+    {
+      for (int vx = 0; vx + view_w <= width && passed; vx += 11)
+      {
+        streamed.stream(Rect{vx * tileSize, vy * tileSize, WINDOW_WIDTH, WINDOW_HEIGHT});
+        for (int y = vy; y < vy + view_h && passed; ++y)
+          for (int x = vx; x < vx + view_w && passed; ++x)
+            if (streamed.get(x, y) != reference.get(x, y))
+            {
+              std::cout << "tile " << x << ", " << y << " is '" << streamed.get(x, y) << "', not '"
+                        << reference.get(x, y) << "'" << std::endl;
+              passed = false;
+            }
+
+        // the last tile looked at, in the chunk used most recently;
+        // changed chunks stay in memory however small the budget is,
+        // so only the bottom ones are changed
+        if (vy == 0)
+        {
+          streamed.set(vx + view_w - 1, view_h - 1, ' ');
+          reference.set(vx + view_w - 1, view_h - 1, ' ');
+        }
+      }
+    }
+    const ChunkStats &stats = streamed.chunkStats();
+    if (stats.evictions == 0)
+    {
+      std::cout << "no chunk was dropped" << std::endl;
+      passed = false;
+    }
+
+    // a byte in the middle of the first chunk
+    std::string bytes = readFile(world_path);
+    size_t offset = (unsigned char)bytes[28] | (unsigned char)bytes[29] << 8 |
+                    (unsigned char)bytes[30] << 16 | size_t((unsigned char)bytes[31]) << 24;
+    bytes[offset + 100] ^= 0x55;
+    writeFile(world_path, bytes);
+
+    LevelMap broken;
+    broken.read(world_path);
+    for (int y = 0; y < height; ++y)
+      for (int x = 0; x < width; ++x)
+        broken.get(x, y);
+    if (broken.get(5, 5) != '#' || broken.error().empty() || broken.get(CHUNK_TILES, 5) != reference.get(CHUNK_TILES, 5))
+    {
+      std::cout << "the corrupt chunk is not replaced by walls" << std::endl;
+      passed = false;
+    }
+  } catch (std::runtime_error &exc) {
+    std::cout << exc.what() << std::endl;
+    passed = false;
+  }
+
+  std::remove(text_path.c_str());
+  std::remove(world_path.c_str());
+  return passed;
+}
+
+// a tick sees the events up to its end in order, a press and release
+// within one tick still holds the key for it, and a full queue drops
+// and counts; then the queue itself between two threads
+static bool checkInput()
+{
+  InputQueue keys;
+  std::vector<double> applied;
+  bool passed = true;
+
+  keys.push(1, true, 0.10);
+  keys.push(1, false, 0.15);
+  keys.push(2, true, 0.30);
+  keys.advance(0.2, &applied);
+  expect(passed, keys.held(1) && !keys.held(2), "a tap is not seen by its tick");
+  expect(passed, applied == std::vector<double>{0.10, 0.15}, "events are not applied in order");
+  keys.advance(0.4, &applied);
+  expect(passed, !keys.held(1) && keys.held(2), "a tap outlives its tick");
+  expect(passed, applied.size() == 3, "an event is applied twice");
+
+  const int extra = 10;
+  for (size_t i = 0; i < InputQueue::CAPACITY + extra; ++i)
+    keys.push(3, i % 2 == 0, 1.0);
+  keys.advance(2.0);
+  expect(passed, keys.dropped() == extra, "a full queue does not count what it drops");
+
+  // the consumer sees every item once, in order
+  const size_t n = 1000000;
+  SpscQueue<size_t, 64> queue;
+  std::thread producer([&]() {
+    for (size_t i = 0; i < n; ++i)
+      while (!queue.push(i))
+        std::this_thread::yield();
+  });
+  size_t next = 0;
+  while (next < n)
+  {
+    const size_t *item = queue.front();
+    if (item == nullptr)
+    {
+      std::this_thread::yield();
+      continue;
+    }
+    if (*item != next)
+      break;
+    queue.pop();
+    ++next;
+  }
+  producer.join();
+  expect(passed, next == n, "items are lost or reordered between threads");
+
+  return passed;
+}
+
+// a job runs after the jobs it waits for, what it throws reaches
+// wait(), and parallelFor covers its range once in pieces of at most
+// grain; with no workers as well as with some
+static bool checkJobs()
+{
+  bool passed = true;
+
+  for (int threads : {1, 4})
+  {
+    JobSystem jobs(threads);
+    std::string pool = std::to_string(threads) + " threads: ";
+
+    for (int round = 0; round < 1000 && passed; ++round)
+    {
+      std::atomic<int> clock{0};
+      int a = -1, b = -1, c = -1, d = -1;
+      JobSystem::Handle ja = jobs.submit([&]() { a = clock++; });
+      JobSystem::Handle jb = jobs.submit([&]() { b = clock++; }, {ja});
+      JobSystem::Handle jc = jobs.submit([&]() { c = clock++; }, {ja});
+      JobSystem::Handle jd = jobs.submit([&]() { d = clock++; }, {jb, jc});
+      jobs.wait(jd);
+      expect(passed, a < b && a < c && b < d && c < d, pool + "a job ran before one it waits for");
+    }
+
+    JobSystem::Handle failing = jobs.submit([]() { throw std::runtime_error("job failed"); });
+    try {
+      jobs.wait(failing);
+      expect(passed, false, pool + "wait() does not rethrow");
+    } catch (std::runtime_error &exc) {
+      expect(passed, std::string(exc.what()) == "job failed", pool + "wait() rethrows something else");
+    }
+
+    for (int grain : {1, 7, 1000})
+    {
+      const int begin = 3, end = 500;
+      std::vector<std::atomic<int>> seen(end);
+      std::atomic<bool> too_big{false};
+      jobs.parallelFor(begin, end, grain, [&](int from, int to) {
+        if (to - from > grain || from >= to)
+          too_big = true;
+        for (int i = from; i < to; ++i)
+          seen[i]++;
+      });
+
+      bool once = !too_big;
+      for (int i = 0; i < end; ++i)
+        once = once && seen[i] == (i >= begin ? 1 : 0);
+      expect(passed, once, pool + "parallelFor with grain " + std::to_string(grain) + " misses the range");
+    }
+
+    try {
+      jobs.parallelFor(0, 100, 10, [](int from, int) {
+        if (from == 50)
+          throw std::runtime_error("range failed");
+      });
+      expect(passed, false, pool + "parallelFor does not rethrow");
+    } catch (std::runtime_error &) {
+    }
+  }
+
+  return passed;
+}
+
+// the map drawn row by row, in bands on four threads, against every
+// tile drawn on its own with TileAtlas::drawTile; for areas cut at odd
+// pixels, with the camera inside the map and with the map smaller than
+// the screen, where the rest is cleared
+static bool checkRedraw()
+{
+  const std::string path = "selftest_redraw.txt";
+  TileAtlas tiles;
+  loadTiles(tiles);
+  JobSystem jobs(4);
+
+  Image screen(WINDOW_WIDTH, WINDOW_HEIGHT, 4), expected(WINDOW_WIDTH, WINDOW_HEIGHT, 4);
+  const Rect whole{0, 0, WINDOW_WIDTH, WINDOW_HEIGHT};
+  std::vector<Rect> areas{whole, {3, 5, 517, 301}, {1000, 0, 100, WINDOW_HEIGHT}, {-20, 700, 300, 900}};
+  // starting at every pixel of a tile
+  for (int k = 0; k < tileSize; ++k)
+    areas.push_back(Rect{k * 33, k * 65, 200, 40});
+
+  bool passed = true;
+  try {
+    for (Point size : {Point{300, 200}, Point{45, 30}})
+    {
+      writeFile(path, generateMap(size.x, size.y));
+      LevelMap map;
+      Point start = map.read(path);
+
+      Camera camera(WINDOW_WIDTH, WINDOW_HEIGHT);
+      DirtyRegions marks(WINDOW_WIDTH, WINDOW_HEIGHT);
+      camera.setWorld(size.x * tileSize, size.y * tileSize);
+      map.track(marks, camera);
+
+      for (Point at : {start, Point{2345, 1234}, Point{7, 3000}})
+      {
+        camera.jump(Rect{at.x, at.y, tileSize, tileSize});
+        int ox = camera.originX(), oy = camera.originY();
+
+        for (const Rect &area : areas)
+        {
+          // what was on the screen before shows through transparent tiles
+          for (size_t i = 0; i < screen.Size() / sizeof(Pixel); ++i)
+            screen.Data()[i] = expected.Data()[i] = Pixel{uint8_t(i), uint8_t(i >> 8), uint8_t(i >> 16), 255};
+
+          map.drawArea(screen, tiles, area, &jobs);
+
+          Rect clip = Intersect(area, whole);
+          for (int y = clip.y; y < clip.y + clip.h; ++y)
+            for (int x = clip.x; x < clip.x + clip.w; ++x)
+            {
+              int tx = x + ox, ty = y + oy;
+              if (tx < 0 || ty < 0 || tx >= size.x * tileSize || ty >= size.y * tileSize)
+                expected.PutPixel(x, y, backgroundColor);
+            }
+          for (int ty = std::max(clip.y + oy, 0) / tileSize; ty < size.y && ty * tileSize - oy < clip.y + clip.h; ++ty)
+            for (int tx = std::max(clip.x + ox, 0) / tileSize; tx < size.x && tx * tileSize - ox < clip.x + clip.w; ++tx)
+              tiles.drawTile(tiles.id(map.get(tx, ty)), tx * tileSize - ox, ty * tileSize - oy, expected, clip);
+
+          for (int y = 0; y < WINDOW_HEIGHT && passed; ++y)
+            for (int x = 0; x < WINDOW_WIDTH && passed; ++x)
+              if (!samePixel(screen.GetPixel(x, y), expected.GetPixel(x, y)))
+              {
+                std::cout << size.x << "x" << size.y << " map, area " << area.x << ", " << area.y << " "
+                          << area.w << "x" << area.h << ": pixel " << x << ", " << y << " is "
+                          << screen.GetPixel(x, y) << ", not " << expected.GetPixel(x, y) << std::endl;
+                passed = false;
+              }
+        }
+      }
+    }
+  } catch (std::runtime_error &exc) {
+    std::cout << exc.what() << std::endl;
+    passed = false;
+  }
+
+  std::remove(path.c_str());
+  return passed;
+}
+
+// every framebuffer presented has to be the frame as it was submitted,
+// and so does a picture that only gets the rectangles it is told
+// changed; at each depth, with whole frames submitted now and then
+static bool checkPipeline()
+{
+  const int width = 256, height = 192, frames = 300;
+  bool passed = true;
+
+  for (int depth = 1; depth <= FramePipeline::MAX_DEPTH; ++depth)
+  {
+    Image screen(width, height, 4), shown(width, height, 4);
+    std::mutex lock;
+    std::vector<uint64_t> submitted;  // under lock
+    int presented = 0, wrong = -1;    // present thread only
+
+    {
+      FramePipeline pipeline(width, height, depth, [&](const Image &frame, const std::vector<Rect> &changed) {
+        size_t bytes = 0;
+        for (const Rect &r : changed)
+        {
+          for (int y = r.y; y < r.y + r.h; ++y)
+            memcpy(shown.Data() + y * width + r.x, frame.Data() + y * width + r.x, r.w * sizeof(Pixel));
+          bytes += size_t(r.w) * r.h * sizeof(Pixel);
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (wrong < 0 && (frameHash(frame) != submitted[presented] || frameHash(shown) != submitted[presented]))
+          wrong = presented;
+        presented++;
+        return bytes;
+      });
+
+      Random random(11);
+
+      for (int f = 0; f < frames; ++f)
+      {
+        std::vector<Rect> changed;
+        for (int n = 1 + random.below(3); n > 0; --n)
+        {
+          Rect r{random.below(width), random.below(height), 1 + random.below(64), 1 + random.below(64)};
+          r = Intersect(r, Rect{0, 0, width, height});
+          for (int y = r.y; y < r.y + r.h; ++y)
+            for (int x = r.x; x < r.x + r.w; ++x)
+              screen.PutPixel(x, y, Pixel{uint8_t(f), uint8_t(x), uint8_t(y), 255});
+          changed.push_back(r);
+        }
+
+        {
+          std::lock_guard<std::mutex> guard(lock);
+          submitted.push_back(frameHash(screen));
+        }
+        if (f % 17 == 0)
+          pipeline.submitAll(screen);
+        else
+          pipeline.submit(screen, changed);
+      }
+      pipeline.finish();
+    }
+
+    if (presented != frames || wrong >= 0)
+    {
+      std::cout << "depth " << depth << ": " << presented << " of " << frames << " frames shown";
+      if (wrong >= 0)
+        std::cout << ", frame " << wrong << " is not as submitted";
+      std::cout << std::endl;
+      passed = false;
+    }
+  }
+
+  return passed;
+}
+
+// percentiles of the latency histogram are the upper edge of the
+// bucket of the sample, and the pipeline takes one sample per input
+// when the frame showing it has been presented
+static bool checkLatency()
+{
+  bool passed = true;
+  // within the 0.25 ms bucket above the value
+  auto expectNear = [&](const char *what, double got, double low) {
+    expect(passed, got >= low - 1e-9 && got <= low + LatencyHistogram::BUCKET_SECONDS + 1e-9,
+           std::string(what) + " is " + std::to_string(got * 1e3) + " ms, not " + std::to_string(low * 1e3) + " ms");
+  };
+
+  LatencyHistogram h;
+  for (int ms = 1; ms <= 100; ++ms)
+    h.add(ms * 1e-3);
+  expectNear("p50 of 1..100 ms", h.percentile(0.50), 0.050);
+  expectNear("p95 of 1..100 ms", h.percentile(0.95), 0.095);
+  expectNear("p99 of 1..100 ms", h.percentile(0.99), 0.099);
+  expectNear("p100 of 1..100 ms", h.percentile(1.00), 0.100);
+  h.add(0.3);
+  expect(passed, h.percentile(1.0) == 0.3 && h.samples == 101, "a sample slower than the histogram is lost");
+
+  // frame f is shown 4 ms after its inputs
+  const int frames = 50;
+  double now = 0.0;  // present thread only
+  FramePipeline pipeline(16, 16, 3, [&](const Image &, const std::vector<Rect> &) {
+    now += 0.010;
+    return size_t(0);
+  }, nullptr, nullptr, [&]() { return now + 0.004; });
+
+  Image screen(16, 16, 4);
+  long inputs = 0;
+  for (int f = 1; f <= frames; ++f)
+  {
+    // every third frame shows no input, every fifth two
+    std::vector<double> times;
+    if (f % 3 != 0)
+      times.push_back(f * 0.010);
+    if (f % 5 == 0)
+      times.push_back(f * 0.010);
+    inputs += long(times.size());
+    pipeline.submitAll(screen, times);
+  }
+  pipeline.finish();
+
+  LatencyHistogram seen = pipeline.inputLatency();
+  expect(passed, seen.samples == inputs,
+         std::to_string(seen.samples) + " latencies taken for " + std::to_string(inputs) + " inputs");
+  expectNear("p50 of the pipeline", seen.percentile(0.5), 0.004);
+  expectNear("slowest of the pipeline", seen.max, 0.004);
+
+  return passed;
+}
+
+// every tile of the map, bottom row first
+static std::string allTiles(const LevelMap &map)
+{
+  std::string tiles;
+  for (int y = 0; y < map.height(); ++y)
+    for (int x = 0; x < map.width(); ++x)
+      tiles += map.get(x, y);
+  return tiles;
+}
+
+static bool samePlayer(const PlayerState &a, const PlayerState &b)
+{
+  auto same = [](Point p, Point q) { return p.x == q.x && p.y == q.y; };
+  return same(a.coords, b.coords) && same(a.old_coords, b.old_coords) && same(a.tick_coords, b.tick_coords) &&
+         a.dir == b.dir && a.status == b.status && a.smash_cooldown == b.smash_cooldown;
+}
+
+// a game saved and read back is the game as it was saved; broken save
+// files throw, and so does a save that does not fit its level, which
+// leaves the level being played as it was
+static bool checkSave()
+{
+  const std::string map_path = "selftest_save.txt", save_path = "selftest_save.sav";
+  bool passed = true;
+
+  try {
+    TileAtlas tiles;
+    loadTiles(tiles);
+    LevelSet levels(tiles, WINDOW_WIDTH, WINDOW_HEIGHT);
+    writeFile(map_path, generateMap(200, 150));
+    LevelMap *Level = &levels.open(1, map_path);
+
+    Player player(levels.start(), Image(tileSize, tileSize, 4), Image(tileSize, tileSize, 4));
+    Camera camera(WINDOW_WIDTH, WINDOW_HEIGHT);
+    DirtyRegions dirty(WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    // the game as it is saved
+    const char symbols[] = ".b%# *";
+    for (int i = 0; i < 500; ++i)
+      Level->set((i * 37) % Level->width(), (i * 11) % Level->height(), symbols[i % 6]);
+    for (int i = 0; i < ANIMATION_FREQUENCY + 7; ++i)
+      Level->animation();
+    PlayerState saved_player{{48, 64}, {44, 64}, {46, 64}, MovementDir::UP, playerStatus::OK, 3};
+    player.setState(saved_player);
+
+    std::string saved_tiles = allTiles(*Level);
+    int saved_tick = Level->animationTick();
+    bool saved_frame = Level->animationFrame();
+    writeSave(save_path, captureGame(levels.number(), *Level, player));
+
+    // played on, then loaded
+    Level->restart(0);
+    Level->set(5, 5, '.');
+    player.setState(PlayerState{{16, 16}, {16, 16}, {16, 16}, MovementDir::LEFT, playerStatus::DEAD, 0});
+    Level = &applySave(readSave(save_path), levels, player, camera, dirty);
+
+    expect(passed, allTiles(*Level) == saved_tiles, "the tiles loaded are not the tiles saved");
+    expect(passed, samePlayer(player.state(), saved_player), "the player loaded is not the player saved");
+    expect(passed, Level->animationTick() == saved_tick && Level->animationFrame() == saved_frame,
+           "the space animation loaded is not the one saved");
+
+    // the header is magic, version, payload size and checksum
+    std::string bytes = readFile(save_path);
+    auto expectBroken = [&](const std::string &file, const char *what) {
+      writeFile(save_path, file);
+      try {
+        readSave(save_path);
+        expect(passed, false, std::string(what) + " is read");
+      } catch (std::runtime_error &) {
+      }
+    };
+    std::string flipped = bytes, other_version = bytes;
+    flipped[bytes.size() / 2] ^= 0x10;
+    other_version[4]++;
+    expectBroken(flipped, "a save with a byte flipped");
+    expectBroken(bytes.substr(0, bytes.size() - 3), "a truncated save");
+    expectBroken(bytes.substr(0, 10), "a save without its header");
+    expectBroken(other_version, "a save of another version");
+
+    // level 2 is nowhere near this wide
+    SaveState misfit = captureGame(2, *Level, player);
+    misfit.tiles.push_back(TileChange{60000, 1, 0, '.'});
+    std::string before = allTiles(*Level);
+    try {
+      applySave(misfit, levels, player, camera, dirty);
+      expect(passed, false, "a save that does not fit its level is loaded");
+    } catch (std::runtime_error &) {
+    }
+    expect(passed, levels.number() == 1 && &levels.current() == Level && allTiles(*Level) == before &&
+                       samePlayer(player.state(), saved_player),
+           "a save that does not fit its level changes the game");
+  } catch (std::runtime_error &exc) {
+    std::cout << exc.what() << std::endl;
+    passed = false;
+  }
+
+  std::remove(map_path.c_str());
+  std::remove(save_path.c_str());
+  return passed;
+}
+
+// the first pixel where two screens differ, -1 if there is none
+static long firstDifference(const Image &a, const Image &b)
+{
+  size_t n = size_t(a.Width()) * a.Height();
+  for (size_t i = 0; i < n; ++i)
+    if (!samePixel(a.Data()[i], b.Data()[i]))
+      return long(i);
+  return -1;
+}
+
+// random tile changes, checkpoints gone back to and starting over, on
+// a text map and on world maps keeping one to three chunks: the tiles
+// are always the ones saved with the checkpoint, however old it is and
+// whatever was changed in the chunks it shares with the map, and the
+// screen repainted only where restore() says is the full redraw
+static bool checkSnapshots()
+{
+  const int width = 300, height = 200;
+  const std::string text_path = "selftest_snapshots.txt", world_path = "selftest_snapshots.lvl";
+  bool passed = true;
+
+  try {
+    TileAtlas tiles;
+    loadTiles(tiles);
+    writeFile(text_path, generateMap(width, height));
+    {
+      LevelMap text;
+      text.write(world_path, text.read(text_path));
+    }
+
+    for (int budget : {0, 1, 2, 3})
+    {
+      std::string name = budget == 0 ? "text map" : "world map keeping " + std::to_string(budget) + " chunks";
+      LevelMap map;
+      if (budget > 0)
+        map.setChunkBudget(budget);
+      Point start = map.read(budget == 0 ? text_path : world_path);
+
+      Player player(start, Image("../resources/tiles/knight_left.png"), Image("../resources/tiles/knight_right.png"));
+      Camera camera(WINDOW_WIDTH, WINDOW_HEIGHT);
+      DirtyRegions dirty(WINDOW_WIDTH, WINDOW_HEIGHT);
+      showLevel(map, player, camera);
+      map.track(dirty, camera);
+      map.stream(camera.shown());
+
+      Image screen(WINDOW_WIDTH, WINDOW_HEIGHT, 4), full(WINDOW_WIDTH, WINDOW_HEIGHT, 4);
+      dirty.addAll();
+      repaint(screen, map, tiles, player, camera, dirty);
+
+      // checkpoints with the tiles they were taken with
+      std::vector<std::pair<Checkpoint, std::string>> kept;
+      const std::string tiles_read = allTiles(map);
+      std::string tiles_now = tiles_read;
+      Random random(budget + 5);
+      const char symbols[] = ".b%# *x";
+      Rect view = camera.shown();
+
+      for (int step = 0; step < 400 && passed; ++step)
+      {
+        int what = random.below(10);
+        if (what < 6)
+        {
+          // half of the changes are on the screen
+          int x = random.below(width), y = random.below(height);
+          if (what < 3)
+          {
+            x = std::min(view.x / tileSize + random.below(view.w / tileSize), width - 1);
+            y = std::min(view.y / tileSize + random.below(view.h / tileSize), height - 1);
+          }
+          char c = symbols[random.below(7)];
+          map.set(x, y, c);
+          tiles_now[size_t(y) * width + x] = c;
+        }
+        else if (what < 8 || kept.empty())
+        {
+          if (kept.size() == 8)
+            kept.erase(kept.begin() + random.below(8));
+          kept.emplace_back(takeCheckpoint(map, player), tiles_now);
+        }
+        else if (what == 9)
+        {
+          restartLevel(map, player, start, camera, dirty);
+          tiles_now = tiles_read;
+        }
+        else
+        {
+          const auto &back = kept[random.below(int(kept.size()))];
+          restoreCheckpoint(map, player, back.first, camera, dirty);
+          tiles_now = back.second;
+        }
+        expect(passed, allTiles(map) == tiles_now, name + ": step " + std::to_string(step) + " left other tiles");
+        map.stream(camera.shown());
+        repaint(screen, map, tiles, player, camera, dirty);
+
+        if (what >= 8)
+        {
+          dirty.addAll();
+          repaint(full, map, tiles, player, camera, dirty);
+          long at = firstDifference(screen, full);
+          expect(passed, at < 0, name + ": step " + std::to_string(step) + ", pixel " +
+                                     std::to_string(at % WINDOW_WIDTH) + ", " + std::to_string(at / WINDOW_WIDTH) +
+                                     " is not the full redraw");
+        }
+      }
+
+      // the oldest first, after all the changes made since
+      for (size_t i = 0; i < kept.size() && passed; ++i)
+      {
+        restoreCheckpoint(map, player, kept[i].first, camera, dirty);
+        expect(passed, allTiles(map) == kept[i].second, name + ": checkpoint " + std::to_string(i) + " of the end is lost");
+      }
+    }
+  } catch (std::runtime_error &exc) {
+    std::cout << exc.what() << std::endl;
+    passed = false;
+  }
+
+  std::remove(text_path.c_str());
+  std::remove(world_path.c_str());
+  return passed;
+}
+
+// the player walked, run and jumped about a map much bigger than the
+// screen, with the camera following it frame by frame, on a text map
+// and on a world map streaming its chunks: every frame the shifted
+// screen with its uncovered strips repainted is the full redraw
+static bool checkScroll()
+{
+  const int width = 300, height = 200, frames = 500;
+  const std::string text_path = "selftest_scroll.txt", world_path = "selftest_scroll.lvl";
+  bool passed = true;
+
+  try {
+    TileAtlas tiles;
+    loadTiles(tiles);
+    writeFile(text_path, generateMap(width, height));
+    {
+      LevelMap text;
+      text.write(world_path, text.read(text_path));
+    }
+
+    for (const std::string &path : {text_path, world_path})
+    {
+      LevelMap map;
+      if (path == world_path)
+        map.setChunkBudget(4);
+      Point start = map.read(path);
+
+      Player player(start, Image("../resources/tiles/knight_left.png"), Image("../resources/tiles/knight_right.png"));
+      Camera camera(WINDOW_WIDTH, WINDOW_HEIGHT);
+      DirtyRegions dirty(WINDOW_WIDTH, WINDOW_HEIGHT);
+      showLevel(map, player, camera);
+      map.track(dirty, camera);
+      map.stream(camera.shown());
+
+      Image screen(WINDOW_WIDTH, WINDOW_HEIGHT, 4), full(WINDOW_WIDTH, WINDOW_HEIGHT, 4);
+      dirty.addAll();
+      repaint(screen, map, tiles, player, camera, dirty);
+
+      Random random(13);
+      Point at = start, speed{0, 0};
+      for (int frame = 0; frame < frames && passed; ++frame)
+      {
+        // a new way to go now and then, sometimes far away at once
+        if (random.below(30) == 0)
+          speed = Point{random.below(49) - 24, random.below(49) - 24};
+        if (random.below(100) == 0)
+          at = Point{random.below(width * tileSize), random.below(height * tileSize)};
+        at.x = std::max(0, std::min(at.x + speed.x, (width - 1) * tileSize));
+        at.y = std::max(0, std::min(at.y + speed.y, (height - 1) * tileSize));
+
+        // the sprite is put straight there, which placePlayer() does not
+        // see as a move: where it was and where it is are marked here
+        dirty.add(camera.toScreen(player.bounds()));
+        player.setPos(at.x, at.y);
+        dirty.add(camera.toScreen(player.bounds()));
+        placePlayer(player, 1.0, camera, dirty);
+        camera.scroll(screen, dirty);
+        map.animation();
+        map.stream(camera.shown());
+        repaint(screen, map, tiles, player, camera, dirty);
+
+        dirty.addAll();
+        repaint(full, map, tiles, player, camera, dirty);
+        long differs = firstDifference(screen, full);
+        expect(passed, differs < 0, path + ": frame " + std::to_string(frame) + " at " + std::to_string(camera.originX()) +
+                                        ", " + std::to_string(camera.originY()) + ", pixel " +
+                                        std::to_string(differs % WINDOW_WIDTH) + ", " +
+                                        std::to_string(differs / WINDOW_WIDTH) + " is not the full redraw");
+      }
+    }
+  } catch (std::runtime_error &exc) {
+    std::cout << exc.what() << std::endl;
+    passed = false;
+  }
+
+  std::remove(text_path.c_str());
+  std::remove(world_path.c_str());
+  return passed;
+}
+
+// random walking and smashing on a small map, gone back by a few ticks
+// at a time and by long ways past keyframes, with a ring of changes much
+// smaller than the tiles set and long after both rings went round: the
+// tiles, the player and the space animation are always the ones of the
+// tick it went back to
+static bool checkRewind()
+{
+  const int width = 40, height = 30, max_changes = 24;
+  const int kept_ticks = REWIND_SECONDS * TICKS_PER_SECOND + 1;
+  const std::string path = "selftest_rewind.txt";
+  bool passed = true;
+
+  struct Tick
+  {
+    std::string tiles;
+    PlayerState player;
+    int animation_tick;
+    bool animation_frame;
+    long changes;   // tiles set up to this tick
+  };
+
+  try {
+    // nothing under the comment kills the player or ends the level,
+    // and a third of the floor is breakable walls to smash
+    Random random(19);
+    std::string text = generateMap(width, height);
+    for (size_t i = text.find('\n'); i < text.size(); ++i)
+    {
+      if (text[i] == ' ' || text[i] == 'x')
+        text[i] = '.';
+      if (text[i] == '.' && random.below(3) == 0)
+        text[i] = '%';
+    }
+    writeFile(path, text);
+
+    LevelMap map;
+    Point start = map.read(path);
+    Player player(start, Image("../resources/tiles/knight_left.png"), Image("../resources/tiles/knight_right.png"));
+    Camera camera(WINDOW_WIDTH, WINDOW_HEIGHT);
+    DirtyRegions dirty(WINDOW_WIDTH, WINDOW_HEIGHT);
+    showLevel(map, player, camera);
+
+    Rewind rewind(max_changes);
+    rewind.reset(map, player);
+
+    // every tick since the reset that can still be gone back to;
+    // the last one is now, the first one is tick first
+    std::vector<Tick> ticks{Tick{allTiles(map), player.state(), map.animationTick(), map.animationFrame(), 0}};
+    long first = 0;
+    long past_keyframe = 0, across_records = 0, across_changes = 0;
+    Controls controls;
+
+    for (int round = 0; round < 300 && passed; ++round)
+    {
+      for (int played = random.below(400); played > 0; --played)
+      {
+        if (random.below(15) == 0)
+        {
+          controls = Controls();
+          controls.up = random.below(3) == 0;
+          controls.down = !controls.up && random.below(2) == 0;
+          controls.left = random.below(3) == 0;
+          controls.right = !controls.left && random.below(2) == 0;
+          controls.smash = random.below(2) == 0;
+        }
+        simulateTick(player, map, controls);
+        rewind.record(map, player);
+
+        Tick now{allTiles(map), player.state(), map.animationTick(), map.animationFrame(), ticks.back().changes};
+        for (size_t i = 0; i < now.tiles.size(); ++i)
+          now.changes += now.tiles[i] != ticks.back().tiles[i];
+        ticks.push_back(now);
+      }
+      if (ticks.size() > size_t(3 * kept_ticks))
+      {
+        first += long(ticks.size()) - 2 * kept_ticks;
+        ticks.erase(ticks.begin(), ticks.end() - 2 * kept_ticks);
+      }
+
+      // held down for a while, a long way, anywhere, or further than kept
+      int kind = random.below(10);
+      for (int times = kind < 4 ? 1 + random.below(30) : 1; times > 0 && passed; --times)
+      {
+        int n = kind < 4 ? REWIND_SPEED
+              : kind < 7 ? REWIND_KEYFRAME_TICKS + 1 + random.below(2 * REWIND_KEYFRAME_TICKS)
+              : kind < 9 ? random.below(rewind.available() + 1)
+              : rewind.available() + random.below(10);
+        int can = rewind.available();
+        long now = first + long(ticks.size()) - 1;
+        expect(passed, can < int(ticks.size()), "round " + std::to_string(round) + ": more ticks kept than played");
+        if (!passed)
+          break;
+
+        int went = rewind.back(n, map, player, camera, dirty);
+        expect(passed, went == std::min(n, can), "round " + std::to_string(round) + ": went back " +
+                                                     std::to_string(went) + " ticks of " + std::to_string(n));
+        went = std::min(went, int(ticks.size()) - 1);
+        const Tick &then = ticks[ticks.size() - 1 - went];
+        std::string where = "round " + std::to_string(round) + ", " + std::to_string(went) + " ticks back from " +
+                            std::to_string(now) + ": ";
+        expect(passed, allTiles(map) == then.tiles, where + "not the tiles of then");
+        expect(passed, samePlayer(player.state(), then.player), where + "not the player of then");
+        expect(passed, map.animationTick() == then.animation_tick && map.animationFrame() == then.animation_frame,
+               where + "not the space animation of then");
+
+        past_keyframe += went > REWIND_KEYFRAME_TICKS;
+        across_records += now / kept_ticks != (now - went) / kept_ticks;
+        across_changes += ticks.back().changes / max_changes != then.changes / max_changes;
+        ticks.resize(ticks.size() - went);
+      }
+    }
+
+    expect(passed, past_keyframe > 0 && across_records > 0 && across_changes > 0,
+           "the rewinds went past " + std::to_string(past_keyframe) + " keyframes, across the end of the records " +
+           std::to_string(across_records) + " times and of the changes " + std::to_string(across_changes) + " times");
+  } catch (std::runtime_error &exc) {
+    std::cout << exc.what() << std::endl;
+    passed = false;
+  }
+
+  std::remove(path.c_str());
+  return passed;
+}
+
+struct SelfTest
+{
+  const char *name;
+  bool (*run)();
+};
+
+static const SelfTest tests[] = {
+  {"blend", checkBlend},
+  {"tiles", checkTileAllocations},
+  {"parser", checkParser},
+  {"chunks", checkChunks},
+  {"input", checkInput},
+  {"jobs", checkJobs},
+  {"redraw", checkRedraw},
+  {"scroll", checkScroll},
+  {"pipeline", checkPipeline},
+  {"latency", checkLatency},
+  {"save", checkSave},
+  {"snapshots", checkSnapshots},
+  {"rewind", checkRewind},
+};
+
+int runSelfTests(const std::string &only)
+{
+  int run = 0, failed = 0;
+  for (const SelfTest &test : tests)
+  {
+    if (!only.empty() && only != test.name)
+      continue;
+
+    bool passed = false;
+    try {
+      passed = test.run();
+    } catch (std::runtime_error &exc) {
+      std::cout << exc.what() << std::endl;
+    }
+    std::cout << test.name << ": " << (passed ? "ok" : "FAILED") << std::endl;
+    run++;
+    failed += !passed;
+  }
+
+  if (run == 0)
+  {
+    std::cout << "no self test called " << only << std::endl;
+    return 1;
+  }
+  return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,13 @@
+#ifndef MAIN_SELFTEST_H
+#define MAIN_SELFTEST_H
+
+#include <string>
+
+// checks of the game code against simple references, run by headless
+// --selftest; every check reports the first difference it finds
+//
+// runs the check called only, or all of them when only is empty;
+// returns 0 when all pass, 1 otherwise
+int runSelfTests(const std::string &only);
+
+#endif //MAIN_SELFTEST_H
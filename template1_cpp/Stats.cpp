@@ -0,0 +1,118 @@
+#include "Stats.h"
+
+#include <algorithm>
+#include <cmath>
+
+void FrameStats::frame(size_t a_dirty_pixels, size_t a_upload_bytes, double a_cpu_seconds, double a_wall_seconds)
+{
+  frames++;
+
+  dirty_pixels = a_dirty_pixels;
+  upload_bytes = a_upload_bytes;
+  cpu_seconds = a_cpu_seconds;
+
+  cpu_total += cpu_seconds;
+  wall_total += a_wall_seconds;
+  if (cpu_seconds > cpu_max)
+    cpu_max = cpu_seconds;
+
+  dirty_total += dirty_pixels;
+  upload_total += upload_bytes;
+  if (dirty_pixels > dirty_max)
+    dirty_max = dirty_pixels;
+}
+
+void FrameStats::print(std::ostream &out) const
+{
+  if (frames == 0)
+    return;
+
+  out << "frames: " << frames << std::endl;
+  out << "dirty pixels per frame: avg " << dirty_total / frames << ", max " << dirty_max << std::endl;
+  out << "uploaded bytes per frame: avg " << upload_total / frames << std::endl;
+  out << "cpu time per frame: avg " << cpu_total / frames * 1e3 << " ms, max " << cpu_max * 1e3 << " ms" << std::endl;
+  if (wall_total > 0.0)
+    out << "cpu usage: " << cpu_total / wall_total * 100.0 << "%" << std::endl;
+}
+
+static const char *stageNames[StageStats::N_STAGES] = {"simulate", "rasterize", "copy", "wait", "present"};
+
+void StageStats::add(Stage stage, double seconds)
+{
+  count[stage]++;
+  total[stage] += seconds;
+  if (seconds > max[stage])
+    max[stage] = seconds;
+}
+
+void StageStats::merge(const StageStats &other)
+{
+  for (int i = 0; i < N_STAGES; ++i)
+  {
+    count[i] += other.count[i];
+    total[i] += other.total[i];
+    if (other.max[i] > max[i])
+      max[i] = other.max[i];
+  }
+}
+
+void StageStats::print(std::ostream &out) const
+{
+  // the game thread runs simulate, rasterize and copy one after another,
+  // waiting is time lost to a slower present
+  double producer = 0.0, slowest = 0.0;
+  for (int i = SIMULATE; i <= COPY; ++i)
+    if (count[i] > 0)
+      producer += total[i] / count[i];
+
+  for (int i = 0; i < N_STAGES; ++i)
+  {
+    if (count[i] == 0)
+      continue;
+    out << stageNames[i] << ": avg " << total[i] / count[i] * 1e6 << " us, max " << max[i] * 1e6 << " us" << std::endl;
+  }
+
+  if (count[PRESENT] > 0)
+  {
+    slowest = total[PRESENT] / count[PRESENT];
+    out << "frame rate bound by: " << (slowest > producer ? "present" : "game thread") << std::endl;
+  }
+}
+
+constexpr double LatencyHistogram::BUCKET_SECONDS;
+
+void LatencyHistogram::add(double seconds)
+{
+  seconds = std::max(seconds, 0.0);
+  samples++;
+  if (seconds > max)
+    max = seconds;
+  buckets[std::min(int(seconds / BUCKET_SECONDS), int(BUCKETS))]++;
+}
+
+double LatencyHistogram::percentile(double p) const
+{
+  if (samples == 0)
+    return 0.0;
+
+  // the upper edge of the bucket holding the sample, the slowest one
+  // is known exactly
+  long rank = std::max(1L, long(std::ceil(p * samples))), seen = 0;
+  for (int i = 0; i < BUCKETS; ++i)
+  {
+    seen += buckets[i];
+    if (seen >= rank)
+      return std::min((i + 1) * BUCKET_SECONDS, max);
+  }
+  return max;
+}
+
+void LatencyHistogram::print(std::ostream &out) const
+{
+  if (samples == 0)
+    return;
+
+  out << "input to screen: p50 " << percentile(0.50) * 1e3 << " ms, p95 " << percentile(0.95) * 1e3
+      << " ms, p99 " << percentile(0.99) * 1e3 << " ms, max " << max * 1e3 << " ms (" << samples
+      << " inputs)" << std::endl;
+}
@@ -0,0 +1,72 @@
+#ifndef MAIN_STATS_H
+#define MAIN_STATS_H
+
+#include <cstddef>
+#include <ostream>
+
+// per-frame counters, printed when the game exits
+struct FrameStats
+{
+  // cpu_seconds is the process CPU time used since the previous frame,
+  // wall_seconds the real time that passed
+  void frame(size_t a_dirty_pixels, size_t a_upload_bytes, double a_cpu_seconds, double a_wall_seconds);
+  void print(std::ostream &out) const;
+
+  long frames = 0;
+
+  // values of the last frame
+  size_t dirty_pixels = 0;
+  size_t upload_bytes = 0;
+
+  size_t dirty_total = 0;
+  size_t dirty_max = 0;
+  size_t upload_total = 0;
+
+  double cpu_seconds = 0.0;
+  double cpu_total = 0.0;
+  double cpu_max = 0.0;
+  double wall_total = 0.0;
+};
+
+// time spent in each stage of a frame, printed when the game exits;
+// with the stages pipelined the slowest one bounds the frame rate
+struct StageStats
+{
+  enum Stage
+  {
+    SIMULATE,   // ticks of the frame
+    RASTERIZE,  // scrolling and repainting the screen
+    COPY,       // handing the changed pixels to a framebuffer
+    WAIT,       // waiting for a framebuffer to be presented
+    PRESENT,    // uploading and showing a framebuffer
+    N_STAGES
+  };
+
+  void add(Stage stage, double seconds);
+  // adds up the stages timed by another thread
+  void merge(const StageStats &other);
+  void print(std::ostream &out) const;
+
+  long count[N_STAGES] = {};
+  double total[N_STAGES] = {};
+  double max[N_STAGES] = {};
+};
+
+// how long inputs took to reach the screen, from the key event to the
+// end of presenting the first frame that had seen it
+struct LatencyHistogram
+{
+  static const int BUCKETS = 1000;
+  static constexpr double BUCKET_SECONDS = 0.00025;  // 0.25 ms, up to 250 ms
+
+  void add(double seconds);
+  // the latency the share p (0..1) of the inputs stayed within
+  double percentile(double p) const;
+  void print(std::ostream &out) const;
+
+  long samples = 0;
+  double max = 0.0;
+  long buckets[BUCKETS + 1] = {};  // the last one is everything slower
+};
+
+#endif //MAIN_STATS_H
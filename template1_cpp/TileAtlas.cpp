@@ -0,0 +1,48 @@
+#include "TileAtlas.h"
+
+#include <cstring>
+#include <stdexcept>
+
+TileAtlas::TileAtlas() : pixels(tileSize, tileSize * MAX_TILES, 4)
+{
+  memset(lookup, NO_TILE, sizeof(lookup));
+}
+
+int TileAtlas::add(char sym, Image &tile)
+{
+  if (n_tiles == MAX_TILES)
+    throw std::runtime_error("Too many tiles in the atlas");
+
+  if (tile.Width() < tileSize || tile.Height() < tileSize)
+    throw std::runtime_error("Tile image is smaller than a tile");
+
+  int id = n_tiles++;
+  Pixel *to = pixels.Data() + id * tileSize * tileSize;
+
+  opaque[id] = true;
+  for (int y = 0; y < tileSize; ++y)
+  {
+    memcpy(to + y * tileSize, tile.Data() + y * tile.Width(), tileSize * sizeof(Pixel));
+    for (int x = 0; x < tileSize; ++x)
+      opaque[id] = opaque[id] && to[y * tileSize + x].a == 255;
+  }
+
+  alias(sym, id);
+  return id;
+}
+
+void TileAtlas::drawTile(int id, int x, int y, Image &screen) const
+{
+  if (id >= n_tiles)
+    return;
+
+  pixels.Blit(screen, Rect{0, id * tileSize, tileSize, tileSize}, x, y);
+}
+
+void TileAtlas::drawTile(int id, int x, int y, Image &screen, const Rect &clip) const
+{
+  if (id >= n_tiles)
+    return;
+
+  pixels.Blit(screen, Rect{0, id * tileSize, tileSize, tileSize}, x, y, clip);
+}
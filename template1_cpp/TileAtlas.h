@@ -0,0 +1,70 @@
+#ifndef MAIN_TILEATLAS_H
+#define MAIN_TILEATLAS_H
+
+#include "Image.h"
+#include "Blend.h"
+
+#include <cstdint>
+#include <cstring>
+
+// all tiles packed one under another into a single image,
+// looked up by map symbol through a flat table
+class TileAtlas
+{
+public:
+  static constexpr int MAX_TILES = 32;
+  static constexpr uint8_t NO_TILE = 0xFF;
+
+  TileAtlas();
+  TileAtlas(const TileAtlas &) = delete;
+  TileAtlas& operator=(const TileAtlas &) = delete;
+
+  // copies the top-left tileSize x tileSize square of the image
+  // into the atlas and binds it to the map symbol, returns tile id
+  int add(char sym, Image &tile);
+
+  // binds one more symbol to an already added tile
+  void alias(char sym, int id) { lookup[(unsigned char) sym] = uint8_t(id); }
+
+  int id(char sym) const { return lookup[(unsigned char) sym]; }
+  int count() const { return n_tiles; }
+
+  // draws tile with its corner at screen pixel (x, y);
+  // NO_TILE (a symbol without a tile) draws nothing
+  void drawTile(int id, int x, int y, Image &screen) const;
+  // same, touching only screen pixels inside clip
+  void drawTile(int id, int x, int y, Image &screen, const Rect &clip) const;
+
+  // draws count pixels of row y of the tile, starting from pixel x,
+  // at to; for drawing the screen one row of pixels at a time
+  void drawRow(int id, int x, int y, Pixel *to, int count) const {
+    if (id >= n_tiles)
+      return;
+
+    const Pixel *from = pixels.Data() + (id * tileSize + y) * tileSize + x;
+    if (opaque[id])
+      memcpy(to, from, count * sizeof(Pixel));
+    else
+      BlendRow(to, from, count);
+  }
+
+  // the same for a whole row of the tile
+  void drawRow(int id, int y, Pixel *to) const {
+    if (id >= n_tiles)
+      return;
+
+    const Pixel *from = pixels.Data() + (id * tileSize + y) * tileSize;
+    if (opaque[id])
+      memcpy(to, from, tileSize * sizeof(Pixel));
+    else
+      BlendRow(to, from, tileSize);
+  }
+
+private:
+  Image pixels;
+  uint8_t lookup[256];
+  bool opaque[MAX_TILES]{};  // copied instead of blended
+  int n_tiles = 0;
+};
+
+#endif //MAIN_TILEATLAS_H
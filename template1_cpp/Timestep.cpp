@@ -0,0 +1,48 @@
+#include "Timestep.h"
+
+FixedTimestep::FixedTimestep(double a_tick_seconds, int a_max_ticks) :
+  tick_seconds(a_tick_seconds), max_ticks(a_max_ticks)
+{
+}
+
+void FixedTimestep::reset(double now)
+{
+  last = now;
+  accumulator = 0.0;
+}
+
+int FixedTimestep::advance(double now)
+{
+  accumulator += now - last;
+  last = now;
+
+  int ticks = int(accumulator / tick_seconds);
+  if (ticks > max_ticks)
+  {
+    accumulator = 0.0;
+    return max_ticks;
+  }
+
+  accumulator -= ticks * tick_seconds;
+  return ticks;
+}
+
+
+FrameLimiter::FrameLimiter(double a_fps) : frame_seconds(a_fps > 0 ? 1.0 / a_fps : 0.0)
+{
+}
+
+double FrameLimiter::timeout(double now) const
+{
+  if (frame_seconds == 0.0)
+    return 0.0;
+  return next - now;
+}
+
+void FrameLimiter::start(double now)
+{
+  // keep the cadence, unless we are more than a frame behind
+  next += frame_seconds;
+  if (next <= now)
+    next = now + frame_seconds;
+}
@@ -0,0 +1,55 @@
+#ifndef MAIN_TIMESTEP_H
+#define MAIN_TIMESTEP_H
+
+// accumulates real time and hands it out in fixed simulation ticks,
+// the fraction of a tick left over is used to interpolate rendering
+class FixedTimestep
+{
+public:
+  // at most max_ticks are simulated per call, the rest of a long
+  // stall is dropped instead of being caught up with
+  explicit FixedTimestep(double a_tick_seconds, int a_max_ticks = 8);
+
+  // starts counting from now, e.g. after a pause
+  void reset(double now);
+
+  // adds the time passed since the last call,
+  // returns the number of ticks to simulate
+  int advance(double now);
+
+  // how far rendering is between the last two ticks, [0, 1)
+  double alpha() const { return accumulator / tick_seconds; }
+
+  double tickSeconds() const { return tick_seconds; }
+
+  // the time the ticks handed out so far have simulated up to; tick i
+  // of the n from the last advance() ends (n - 1 - i) ticks before it
+  double simulatedUntil() const { return last - accumulator; }
+
+private:
+  double tick_seconds;
+  int max_ticks;
+  double last = 0.0;
+  double accumulator = 0.0;
+};
+
+// paces frames to a target rate; the caller sleeps for timeout()
+// (in an event wait, so input still wakes it up) and calls start()
+// when it actually begins a frame
+class FrameLimiter
+{
+public:
+  // fps <= 0 means no limit
+  explicit FrameLimiter(double a_fps);
+
+  // seconds left until the next frame is due, <= 0 if it is due now
+  double timeout(double now) const;
+
+  void start(double now);
+
+private:
+  double frame_seconds;
+  double next = 0.0;
+};
+
+#endif //MAIN_TIMESTEP_H
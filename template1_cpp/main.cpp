@@ -1,179 +1,31 @@
 #include "common.h"
 #include "Image.h"
 #include "Player.h"
-
+#include "Blend.h"
+#include "TileAtlas.h"
+#include "Presenter.h"
+#include "FramePipeline.h"
+#include "DirtyRegions.h"
+#include "Stats.h"
+#include "Game.h"
+#include "InputQueue.h"
+#include "InputRecorder.h"
+#include "Timestep.h"
+#include "Rewind.h"
+#include "SaveGame.h"
+
+#include <chrono>
 #include <vector>
-#include <map>
 #include <iostream>
+#include <memory>
 #include <stdio.h>
 #include <string>
+#include <string.h>
+#include <time.h>
 
 #define GLFW_DLL
 #include <GLFW/glfw3.h>
 
-constexpr GLsizei WINDOW_WIDTH  = 1024,
-                  WINDOW_HEIGHT = 1024,
-                  BORDER_MARGIN = 4;
-
-constexpr int X_TILES = WINDOW_WIDTH  / tileSize,
-              Y_TILES = WINDOW_HEIGHT / tileSize;
-
-constexpr int N_LEVELS = 2;
-constexpr int ANIMATION_FREQUENCY = 50;
-constexpr int SMASH_COOLDOWN = 100; // wall smashing cooldown 
-                                    // (player is unable to break walls during cooldown)
-
-class LevelMap {
-
-public:
-
-  char get(int x, int y) const {
-    return symbols[y][x];
-  }
-
-  void set(int x, int y, char c) {
-    if (c != ' ' && c != '.' && c != '#' && c != '%' && c != 'b' && c != 'x'&& c != '@') {
-      throw std::runtime_error("No such tile");
-    }
-    symbols[y][x] = c;
-  }
-
-  // read map from file
-  // returns player starting position
-  Point read(const std::string &file) {
-
-    FILE *f = fopen(file.c_str(), "r");
-    if (f == nullptr) {
-      throw std::runtime_error("Unable to open file");
-    }
-
-    char c;
-    symbols.resize(Y_TILES);
-
-    int x = 0, y = 0;
-    Point starting_pos{ .x = WINDOW_WIDTH / 2, .y = WINDOW_HEIGHT / 2};
-
-    while ( (c = (char) fgetc(f) ) != EOF ) {
-
-      // ignore \n symbols so that a user could
-      // write level map in multiple lines
-      if (c == '\n') {
-        continue;
-      }
-
-      if (c == '@') {
-        starting_pos.x = x * tileSize;
-        starting_pos.y = y * tileSize;
-        c = '.'; // player is standing on the floor
-      }
-      symbols[y].push_back(c);
-
-      x = (x + 1) % X_TILES;
-      if (x == 0) {
-        y++;
-      }
-    }
-
-    if (x != 0 || y != Y_TILES) {
-      fclose(f);
-      throw std::runtime_error("Wrong number of characters in the file");
-    }
-
-    fclose(f);
-    return starting_pos;
-  };
-
-  void draw(Image &screen, std::map <char, Image> &tile) {
-    char tile_sym;
-
-    for (int x = 0; x < X_TILES; ++x) {
-      for (int y = 0; y < Y_TILES; ++y) {
-
-        tile_sym = symbols[y][x]; 
-
-        tile[ tile_sym ].set_x(x * tileSize);
-        tile[ tile_sym ].set_y(y * tileSize);
-        tile[ tile_sym ].Draw(screen);
-      } 
-    }
-
-  };
-
-  void animation(Image &screen, std::map <char, Image> &tile) {
-    
-    space_animation = (space_animation + 1) % ANIMATION_FREQUENCY;
-
-    if (!space_animation) {
-
-      for (int x = 0; x < X_TILES; ++x) {
-        for (int y = 0; y < Y_TILES; ++y) {
-          switch (symbols[y][x]) {
-            case ' ':
-              symbols[y][x] = '*'; 
-              tile[ '*' ].set_x(x * tileSize);
-              tile[ '*' ].set_y(y * tileSize);
-              tile[ '*' ].Draw(screen);
-              break;
-            case '*':
-              symbols[y][x] = ' ';
-              tile[ ' ' ].set_x(x * tileSize);
-              tile[ ' ' ].set_y(y * tileSize);
-              tile[ ' ' ].Draw(screen); 
-              break;
-            default:
-              break;
-          }
-        }
-      }
-
-    }
-
-  }
-
-  void reset() {
-    for (auto v : symbols) {
-      v.clear();
-    }
-    symbols.clear();
-  };
-
-private:
-  std::vector < std::vector <char> > symbols;
-  int space_animation = 0;
-};
-
-// redraw area near player
-void redrawArea(Player &p, Image &screen, LevelMap &Level, std::map <char, Image> &tile) {
-  auto coords = p.getCoords();
-  int px = coords.x,
-      py = coords.y,
-      pv = p.getSpeed();
-
-  int lx = px / tileSize - pv,
-      rx = px / tileSize + pv,
-      uy = py / tileSize + pv,
-      dy = py / tileSize - pv;
-
-  lx = lx >= 0 ? lx : 0;
-  rx = rx < X_TILES ? rx : X_TILES - 1;
-  dy = dy >= 0 ? dy : 0;
-  uy = uy < Y_TILES ? uy : Y_TILES - 1;
-
-  //std::cout << px / tileSize << " " << py / tileSize << "\n" << lx << " " << rx << "\n" << dy << " " << uy << "\n\n\n";  
-
-  char tile_sym;
-  for (int x = lx; x <= rx; ++x) {
-    for (int y = dy; y <= uy; ++y) {
-      //std::cout << "SDMVLKSKLSRBJK:SRBNJR:" << std::endl;
-      tile_sym = Level.get(x,y); 
-      //std::cout << "voknbkjnetjkbnerejba" << std::endl;
-      tile[ tile_sym ].set_x(x * tileSize);
-      tile[ tile_sym ].set_y(y * tileSize);
-      tile[ tile_sym ].Draw(screen);
-    }
-  }
-}
-
 struct InputState
 {
   bool keys[1024]{}; //массив состояний кнопок - нажата/не нажата
@@ -181,15 +33,29 @@ struct InputState
   bool firstMouse = true;
   bool captureMouse         = true;  // Мышка захвачена нашим приложением или нет?
   bool capturedMouseJustNow = false;
+  bool save = false;  // F5 was pressed
+  bool load = false;  // F9 was pressed
 } static Input;
 
+// F5 and F9 use one file, the autosave another, so going back
+// to the save is always going back to where the player saved
+static const char SAVE_PATH[] = "savegame.sav";
+static const char AUTOSAVE_PATH[] = "autosave.sav";
 
-GLfloat deltaTime = 0.0f;
-GLfloat lastFrame = 0.0f;
+// key presses and releases for the simulation, with the time they came
+static InputQueue Events;
+
+// an input log is being played back instead of the keyboard
+static bool replaying = false;
 
 
 void OnKeyboardPressed(GLFWwindow* window, int key, int scancode, int action, int mode)
 {
+  // a replay takes no keys from the queue, it would only fill up
+  if (action != GLFW_REPEAT && !replaying) {
+    Events.push(key, action == GLFW_PRESS, glfwGetTime());
+  }
+
 	switch (key)
 	{
   case GLFW_KEY_1:
@@ -204,199 +70,31 @@ void OnKeyboardPressed(GLFWwindow* window, int key, int scancode, int action, in
       if (key == GLFW_KEY_ESCAPE) {
         glfwSetWindowShouldClose(window, GL_TRUE);
       }
+      if (key == GLFW_KEY_F5) {
+        Input.save = true;
+      }
+      if (key == GLFW_KEY_F9) {
+        Input.load = true;
+      }
     }
 		else if (action == GLFW_RELEASE)
       Input.keys[key] = false;
 	}
 }
 
-bool mayGo(int x, int y, MovementDir dir, LevelMap &Level) {
-
-  // if % tileSize != 0
-  // then two blocks above/below/to the left/to the right
-  // are on the player's way
-  // otherwise there is only one obstacle
-  bool x2 = x % tileSize != 0,
-       y2 = y % tileSize != 0;
-
-  int xt = x / tileSize, // x_tiles
-      yt = y / tileSize; // y_tiles
-
-  switch(dir)
-  {
-    case MovementDir::UP:
-      if (y + tileSize >= WINDOW_HEIGHT - BORDER_MARGIN) {
-        return false;
-      }
-
-      if (Level.get(xt, yt + 1) == '#' || Level.get(xt, yt + 1) == '%') {
-        return false;
-      }
-
-      if (x2 && (Level.get(xt + 1, yt + 1) == '#' || Level.get(xt + 1, yt + 1) == '%') ) {
-        return false;
-      }
-
-      break;
-
-    case MovementDir::DOWN:
-      if (y <= BORDER_MARGIN) {
-        return false;
-      }
-
-      // the player is far enough from the next tile below
-      if (y2) {
-        return true;
-      }
-
-      if (Level.get(xt, yt - 1) == '#' || Level.get(xt, yt - 1) == '%') {
-        return false;
-      }
-
-      if (x2 && (Level.get(xt + 1, yt - 1) == '#' || Level.get(xt + 1, yt - 1) == '%') ) {
-        return false;
-      }
-
-      break;
-    
-    case MovementDir::LEFT:
-      if (x <= BORDER_MARGIN) {
-        return false;
-      }
-
-      // the player is far enough from the next tile to the left
-      if (x2) {
-        return true;
-      }
-
-      if (Level.get(xt - 1, yt) == '#' || Level.get(xt - 1, yt) == '%') {
-        return false;
-      }
-
-      if (y2 && (Level.get(xt - 1, yt + 1) == '#' || Level.get(xt - 1, yt + 1) == '%') ) {
-        return false;
-      }
-
-      break;
-    
-    case MovementDir::RIGHT:
-      if (x + tileSize >= WINDOW_WIDTH - BORDER_MARGIN) {
-        return false;
-      }
-
-      if (Level.get(xt + 1, yt) == '#' || Level.get(xt + 1, yt) == '%') {
-        return false;
-      }
-
-      if (y2 && (Level.get(xt + 1, yt + 1) == '#' || Level.get(xt + 1, yt + 1) == '%') ) {
-        return false;
-      }
-
-      break;
-    
-    default:
-      break;
-  }
-
-  return true;
-}
-
-void breakWall(Player &player, LevelMap &Level) {
-  // check the tile the player is standing on right now
-  auto coords = player.getCoords();
-  int x = coords.x;
-  int y = coords.y;
-
-  // choosing the tile covered by the
-  // biggest fraction of player tile's
-  // square area
-  x = x / tileSize + int(x % tileSize > tileSize / 2);
-  y = y / tileSize + int(y % tileSize > tileSize / 2);
-
-  if (Level.get(x - 1, y) == '%') {
-    Level.set(x - 1,y,'b');
-    player.smash_cooldown = SMASH_COOLDOWN;
-  }
-  if (Level.get(x + 1, y) == '%') {
-    Level.set(x + 1,y,'b');
-    player.smash_cooldown = SMASH_COOLDOWN;
-  }
-  if (Level.get(x, y - 1) == '%') {
-    Level.set(x,y - 1,'b');
-    player.smash_cooldown = SMASH_COOLDOWN;
-  }
-  if (Level.get(x, y + 1) == '%') {
-    Level.set(x,y + 1,'b');
-    player.smash_cooldown = SMASH_COOLDOWN;
-  }
-}
-
-void processPlayerMovement(Player &player, LevelMap &Level) {
-  auto coords = player.getCoords();
-  int x = coords.x;
-  int y = coords.y;
-
-  if (player.smash_cooldown > 0) {
-    player.smash_cooldown--;
-  }
-
-  if (Input.keys[GLFW_KEY_W]) { 
-    auto dir = MovementDir::UP;
-    if (mayGo(x,y,dir,Level)) {
-      player.ProcessInput(dir);
-    }
-  }
-
-  if (Input.keys[GLFW_KEY_S]) {
-    auto dir = MovementDir::DOWN;
-    if (mayGo(x,y,dir,Level)) {
-      player.ProcessInput(dir);
-    }
-  }
-  
-  if (Input.keys[GLFW_KEY_A]) {
-    auto dir = MovementDir::LEFT;
-    if (mayGo(x,y,dir,Level)) {
-      player.ProcessInput(dir);
-    }
-    player.changeDir(MovementDir::LEFT);
-  }
-  
-  if (Input.keys[GLFW_KEY_D]) {
-    auto dir = MovementDir::RIGHT;
-    if (mayGo(x,y,dir,Level)) {
-      player.ProcessInput(dir);
-    }
-    player.changeDir(MovementDir::RIGHT);
-  }
-
-  if (Input.keys[GLFW_KEY_SPACE] && player.smash_cooldown == 0) {
-    breakWall(player, Level);
-  }
-
-  // check the tile the player is standing on right now
-  coords = player.getCoords();
-  x = coords.x;
-  y = coords.y;
-
-  // choosing the tile covered by the
-  // biggest fraction of player tile's
-  // square area
-  x = x / tileSize + int(x % tileSize > tileSize / 2);
-  y = y / tileSize + int(y % tileSize > tileSize / 2);
-
-  switch (Level.get(x,y))  {
-    case ' ':
-    case '*':
-      player.status = playerStatus::DEAD;
-      break;
-    case 'x':
-      player.status = playerStatus::ESCAPED;
-      break;
-    default:
-      break;
-  }
-  
+// the keys that control the player during the tick ending at until,
+// the times of the key events it is the first to see are added to inputs
+Controls readControls(double until, std::vector<double> &inputs) {
+  Events.advance(until, &inputs);
+
+  Controls controls;
+  controls.up    = Events.held(GLFW_KEY_W);
+  controls.down  = Events.held(GLFW_KEY_S);
+  controls.left  = Events.held(GLFW_KEY_A);
+  controls.right = Events.held(GLFW_KEY_D);
+  controls.smash = Events.held(GLFW_KEY_SPACE);
+  controls.rewind = Events.held(GLFW_KEY_BACKSPACE);
+  return controls;
 }
 
 void OnMouseButtonClicked(GLFWwindow* window, int button, int action, int mods)
@@ -449,90 +147,70 @@ int initGL()
 	std::cout << "Renderer: " << glGetString(GL_RENDERER) << std::endl;
 	std::cout << "Version: " << glGetString(GL_VERSION) << std::endl;
 	std::cout << "GLSL: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
+  std::cout << "Blending: " << BlendBackend() << std::endl;
 
   std::cout << "Controls: "<< std::endl;
   std::cout << "press right mouse button to capture/release mouse cursor  "<< std::endl;
   std::cout << "W, A, S, D - movement  "<< std::endl;
   std::cout << "Spacebar - break green wall  "<< std::endl;
+  std::cout << "Backspace (hold) - go back in time  "<< std::endl;
   std::cout << "press ESC to exit" << std::endl;
 
 	return 0;
 }
 
-void Win(Image &screen, Image &victory, LevelMap &Level, std::map <char, Image> &tile, Player &player, GLFWwindow*  window) {
-  victory.Draw(screen);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); GL_CHECK_ERRORS;
-  glDrawPixels (WINDOW_WIDTH, WINDOW_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, screen.Data()); GL_CHECK_ERRORS;
-  glfwSwapBuffers(window);
-  while (!Input.keys[GLFW_KEY_R] && !Input.keys[GLFW_KEY_ESCAPE]) {
-    glfwPollEvents();
+// shows the message over the screen until key (or ESC) is pressed,
+// replays go on without waiting
+void showMessage(Image &screen, Image &message, int key, FramePipeline &pipeline) {
+  message.Draw(screen);
+  pipeline.submitAll(screen);
+  while (!replaying && !Input.keys[key] && !Input.keys[GLFW_KEY_ESCAPE]) {
+    glfwWaitEvents();
   }
-
-  Level.reset();
-  Point starting_pos;
-  starting_pos = Level.read("../resources/levels/1.txt");   
-
-  player.setPos(starting_pos.x, starting_pos.y);
-  player.setOldPos(starting_pos.x, starting_pos.y);
-  player.status = playerStatus::OK;
-  player.smash_cooldown = 0;
-
-  Level.draw(screen, tile);
 }
 
-void gameOver(Image &screen, Image &game_over, LevelMap &Level, std::map <char, Image> &tile, Player &player, Point starting_pos, GLFWwindow*  window) {
-  game_over.Draw(screen);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); GL_CHECK_ERRORS;
-  glDrawPixels (WINDOW_WIDTH, WINDOW_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, screen.Data()); GL_CHECK_ERRORS;
-  glfwSwapBuffers(window);
-  while (!Input.keys[GLFW_KEY_R] && !Input.keys[GLFW_KEY_ESCAPE]) {
-    glfwPollEvents();
-  }
-
-  // replaying current level
-
-  // restoring broken walls
-  for (int x = 0; x < X_TILES; ++x) {
-    for (int y = 0; y < Y_TILES; ++y) {
-      if (Level.get(x,y) == 'b') {
-        Level.set(x,y,'%');
-      }
-    }
-  }
-
-  // restoring starting position and status
-  player.status = playerStatus::OK;
-  player.smash_cooldown = 0;
-  player.setPos(starting_pos.x, starting_pos.y);
-  player.setOldPos(starting_pos.x, starting_pos.y);
-
-  Level.draw(screen, tile);
+LevelMap &Win(Image &screen, Image &victory, LevelSet &levels, Player &player, FramePipeline &pipeline, Camera &camera, DirtyRegions &dirty) {
+  showMessage(screen, victory, GLFW_KEY_R, pipeline);
+  return startLevel(levels, player, 1, screen, camera, dirty);
 }
 
-void nextLevel(Image &screen, Image &next_level, LevelMap &Level, std::map <char, Image> &tile, Player &player, GLFWwindow*  window, int curLevel) {
-
-  next_level.Draw(screen);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); GL_CHECK_ERRORS;
-  glDrawPixels (WINDOW_WIDTH, WINDOW_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, screen.Data()); GL_CHECK_ERRORS;
-  glfwSwapBuffers(window);
-  while (!Input.keys[GLFW_KEY_P] && !Input.keys[GLFW_KEY_ESCAPE]) {
-    glfwPollEvents();
-  }
-
-  Level.reset();
-  Point starting_pos;
-  starting_pos = Level.read("../resources/levels/" + std::to_string(curLevel) + ".txt");   
-
-  player.setPos(starting_pos.x, starting_pos.y);
-  player.setOldPos(starting_pos.x, starting_pos.y);
-  player.status = playerStatus::OK;
-  player.smash_cooldown = 0;
+void gameOver(Image &screen, Image &game_over, LevelMap &Level, Player &player, Point starting_pos, FramePipeline &pipeline, Camera &camera, DirtyRegions &dirty) {
+  showMessage(screen, game_over, GLFW_KEY_R, pipeline);
+  restartLevel(Level, player, starting_pos, camera, dirty);
+}
 
-  Level.draw(screen, tile);
+LevelMap &nextLevel(Image &screen, Image &next_level, LevelSet &levels, Player &player, FramePipeline &pipeline, Camera &camera, DirtyRegions &dirty, int curLevel) {
+  showMessage(screen, next_level, GLFW_KEY_P, pipeline);
+  return startLevel(levels, player, curLevel, screen, camera, dirty);
 }
 
 int main(int argc, char** argv)
 {
+  // --record FILE saves the input log of the session,
+  // --replay FILE plays one back instead of the keyboard,
+  // --fps N limits the frame rate (0 - no limit),
+  // --pipeline N lets N frames be in flight (1 - each one is shown
+  // before the next one is started, 2 or 3 - more frames, shown later)
+  std::string record_path, replay_path;
+  double target_fps = 60.0;
+  int pipeline_depth = 2;
+  for (int i = 1; i < argc; ++i) {
+    bool has_value = i + 1 < argc;
+    if (!strcmp(argv[i], "--record") && has_value) {
+      record_path = argv[++i];
+    } else if (!strcmp(argv[i], "--replay") && has_value) {
+      replay_path = argv[++i];
+    } else if (!strcmp(argv[i], "--fps") && has_value) {
+      target_fps = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--pipeline") && has_value) {
+      pipeline_depth = atoi(argv[++i]);
+    } else {
+      // a mistyped option would start a game nobody asked for
+      std::cout << "usage: " << argv[0] << " [--record FILE] [--replay FILE] [--fps N] [--pipeline N]" << std::endl;
+      return 1;
+    }
+  }
+
 	if(!glfwInit())
     return -1;
 
@@ -569,6 +247,11 @@ int main(int argc, char** argv)
   glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);  GL_CHECK_ERRORS;
   glClearColor(0.0f, 0.0f, 0.0f, 1.0f); GL_CHECK_ERRORS;
 
+  Presenter presenter(WINDOW_WIDTH, WINDOW_HEIGHT);
+  DirtyRegions dirty(WINDOW_WIDTH, WINDOW_HEIGHT);
+  Camera camera(WINDOW_WIDTH, WINDOW_HEIGHT);
+  FrameStats stats;
+
   Image game_over("../resources/tiles/game_over.png");
   Image next_level("../resources/tiles/next_level.png");
   Image victory("../resources/tiles/victory.png");
@@ -582,94 +265,273 @@ int main(int argc, char** argv)
   victory.set_x(220);
   victory.set_y(350);
 
-  auto tile = std::map <char, Image>();
-
-
-  tile[' '] = Image("../resources/tiles/floor.png");
-  tile['*'] = Image("../resources/tiles/floor.png");
-  tile['x'] = Image("../resources/tiles/floor.png");
-  tile['#'] = Image("../resources/tiles/floor.png");
-  tile['%'] = Image("../resources/tiles/floor.png");
-  tile['b'] = Image("../resources/tiles/floor.png");
-  tile['.'] = Image("../resources/tiles/floor.png");
-
-
-  // drawing everything on the floor
-  Image("../resources/tiles/space_1.png").Draw(tile[' ']);
-  Image("../resources/tiles/space_2.png").Draw(tile['*']);
-  Image("../resources/tiles/exit.png").Draw(tile['x']);
-  Image("../resources/tiles/unbreakable_wall.png").Draw(tile['#']);
-  Image("../resources/tiles/breakable_wall.png").Draw(tile['%']); 
-  // broken wall appears
-  // after breaking a breakable wall.
-  Image("../resources/tiles/broken_wall.png").Draw(tile['b']);
-
+  TileAtlas tiles;
+  // every core draws and decodes
+  JobSystem jobs;
+  loadTiles(tiles, &jobs);
 
   Point starting_pos;
-  LevelMap Level;
+  LevelSet levels(tiles, WINDOW_WIDTH, WINDOW_HEIGHT);
+  LevelMap *Level = nullptr;
+  std::unique_ptr<InputRecorder> recorder;
+  std::unique_ptr<InputReplay> replay;
+  int curLevel = 1;
 
   try {
-    starting_pos = Level.read("../resources/levels/1.txt");    
+    if (!replay_path.empty()) {
+      replay.reset(new InputReplay(replay_path));
+      curLevel = replay->level();
+      replaying = true;
+    }
+    if (!record_path.empty()) {
+      recorder.reset(new InputRecorder(record_path, curLevel));
+    }
+    Level = &levels.open(curLevel);
+    starting_pos = levels.start();
   } catch (std::runtime_error &exc) {
     std::cout << exc.what() << std::endl;
     glfwTerminate();
     return 0;
   }
 
-  Image left = Image("../resources/tiles/floor.png");
-  Image right = Image("../resources/tiles/floor.png");
+  Image left("../resources/tiles/floor.png");
+  Image right("../resources/tiles/floor.png");
 
   Image("../resources/tiles/knight_left.png").Draw(left);
   Image("../resources/tiles/knight_right.png").Draw(right);
 
-  Player player(starting_pos, left, right);
-
-  Level.draw(screen, tile);
-  int curLevel = 1;
+  Player player(starting_pos, std::move(left), std::move(right));
+
+  levels.track(dirty, camera);
+  showLevel(*Level, player, camera);
+  dirty.addAll();
+  Rewind rewind;
+  rewind.reset(*Level, player);
+  Autosave autosave(AUTOSAVE_PATH);
+  long tick = 0;
+
+  FixedTimestep timestep(1.0 / TICKS_PER_SECOND);
+  timestep.reset(glfwGetTime());
+
+  // frames are shown from a thread of their own, the GL context
+  // goes with them
+  glfwMakeContextCurrent(nullptr);
+  FramePipeline pipeline(WINDOW_WIDTH, WINDOW_HEIGHT, pipeline_depth,
+    [&](const Image &frame, const std::vector<Rect> &changed) {
+      for (const Rect &r : changed) {
+        presenter.invalidate(r);
+      }
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); GL_CHECK_ERRORS;
+      presenter.present(frame);
+      glfwSwapBuffers(window);
+      return presenter.lastUploadBytes();
+    },
+    [window]() { glfwMakeContextCurrent(window); },
+    []() { glfwMakeContextCurrent(nullptr); },
+    []() { return glfwGetTime(); });
+  // the first frame is uploaded whole
+  bool whole_frame = true;
+  StageStats stages;
+  // key events not shown yet, and when the latency was last put in the title
+  std::vector<double> inputs;
+  double title_time = glfwGetTime();
+
+  FrameLimiter limiter(target_fps);
+  double cpu_last = double(clock()) / CLOCKS_PER_SEC,
+         wall_last = glfwGetTime();
 
   //game loop
 	while (!glfwWindowShouldClose(window)) {
-		GLfloat currentFrame = glfwGetTime();
-		deltaTime = currentFrame - lastFrame;
-		lastFrame = currentFrame;
+    // sleeping in the event queue until the frame is due,
+    // key presses are still handled meanwhile
+    double timeout = limiter.timeout(glfwGetTime());
+    if (timeout > 0) {
+      glfwWaitEventsTimeout(timeout);
+      continue;
+    }
     glfwPollEvents();
-
-    processPlayerMovement(player, Level);
-    if (player.Moved() || player.smash_cooldown == SMASH_COOLDOWN) {
-      redrawArea(player, screen, Level, tile);      
+    limiter.start(glfwGetTime());
+
+    // F5 saves the game, F9 goes back to the save; a game being
+    // recorded or replayed is never loaded, it would not replay
+    if (Input.save) {
+      Input.save = false;
+      try {
+        autosave.save(SAVE_PATH, curLevel, *Level, player);
+        std::cout << "game saved" << std::endl;
+      } catch (std::runtime_error &exc) {
+        std::cout << exc.what() << std::endl;
+      }
+    }
+    if (Input.load) {
+      Input.load = false;
+      if (!recorder && !replay) {
+        try {
+          // a save that does not fit its level leaves the game as it is
+          Level = &applySave(readSave(SAVE_PATH), levels, player, camera, dirty);
+          curLevel = levels.number();
+          starting_pos = levels.start();
+          rewind.reset(*Level, player);
+          whole_frame = true;
+          timestep.reset(glfwGetTime());
+        } catch (std::runtime_error &exc) {
+          std::cout << exc.what() << std::endl;
+        }
+      }
     }
-    Level.animation(screen, tile);
 
-    player.Draw(screen);
+    // the game advances in fixed ticks however fast frames are drawn
+    auto simulate_start = std::chrono::steady_clock::now();
+    int ticks = timestep.advance(glfwGetTime());
+    for (int i = 0; i < ticks; ++i) {
+      double tick_end = timestep.simulatedUntil() - (ticks - 1 - i) * timestep.tickSeconds();
+      Controls controls = replay ? replay->next() : readControls(tick_end, inputs);
+      if (recorder) {
+        recorder->tick(controls);
+      }
 
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); GL_CHECK_ERRORS;
+      if (controls.rewind) {
+        rewind.back(REWIND_SPEED, *Level, player, camera, dirty);
+      } else {
+        simulateTick(player, *Level, controls);
+        rewind.record(*Level, player);
+      }
 
-    glDrawPixels (WINDOW_WIDTH, WINDOW_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, screen.Data()); GL_CHECK_ERRORS;
+      bool paused = player.status != playerStatus::OK;
 
-    if (player.status == playerStatus::ESCAPED) {
-      curLevel++;
-      if (curLevel > N_LEVELS) {
-        Win(screen, victory, Level, tile, player, window);
-        continue;
-      } 
+      if (player.status == playerStatus::ESCAPED) {
+        try {
+          if (curLevel == N_LEVELS) {
+            Level = &Win(screen, victory, levels, player, pipeline, camera, dirty);
+          } else {
+            Level = &nextLevel(screen, next_level, levels, player, pipeline, camera, dirty, curLevel + 1);
+          }
+          curLevel = levels.number();
+          starting_pos = levels.start();
+          rewind.reset(*Level, player);
+          whole_frame = true;
+        } catch (std::runtime_error &exc) {
+          // the level that is played goes on
+          std::cout << exc.what() << std::endl;
+          restartLevel(*Level, player, starting_pos, camera, dirty);
+          rewind.reset(*Level, player);
+          whole_frame = true;
+        }
+      }
 
-      try { 
-        nextLevel(screen, next_level, Level, tile, player, window, curLevel);
-      } catch (std::runtime_error &exc) {
-        std::cout << exc.what() << std::endl;
-        glfwTerminate();
-        return 0;
+      if (player.status == playerStatus::DEAD) {
+        gameOver(screen, game_over, *Level, player, starting_pos, pipeline, camera, dirty);
+        rewind.reset(*Level, player);
       }
-  
+
+      if (++tick % HASH_INTERVAL == 0 && (recorder || replay)) {
+        uint64_t hash = stateHash(*Level, player);
+        if (recorder) {
+          recorder->checkpoint(hash);
+        }
+        if (replay) {
+          replay->verify(hash);
+        }
+      }
+
+      // time spent looking at a message is not played
+      if (paused) {
+        timestep.reset(glfwGetTime());
+        break;
+      }
+    }
+
+    stages.add(StageStats::SIMULATE, std::chrono::duration<double>(std::chrono::steady_clock::now() - simulate_start).count());
+
+    std::string preload_error = levels.preloadError();
+    if (!preload_error.empty()) {
+      std::cout << preload_error << std::endl;
+    }
+    std::string chunk_error = Level->error();
+    if (!chunk_error.empty()) {
+      std::cout << chunk_error << std::endl;
+    }
+
+    if (!replay) {
+      autosave.update(glfwGetTime(), curLevel, *Level, player);
+    }
+    std::string save_error = autosave.error();
+    if (!save_error.empty()) {
+      std::cout << save_error << std::endl;
+    }
+
+    if (replay && replay->finished()) {
+      glfwSetWindowShouldClose(window, GL_TRUE);
+    }
+
+    auto rasterize_start = std::chrono::steady_clock::now();
+    placePlayer(player, timestep.alpha(), camera, dirty);
+
+    // the whole screen moved, it is uploaded again
+    if (camera.scroll(screen, dirty)) {
+      whole_frame = true;
     }
+    Level->stream(camera.shown());
 
-    if (player.status == playerStatus::DEAD) {
-      gameOver(screen, game_over, Level, tile, player, starting_pos, window);
+    // nothing changed, the last frame stays on the screen; the keys
+    // pressed meanwhile did not change what it shows, they are not timed
+    if (dirty.empty() && !whole_frame) {
+      inputs.clear();
+      continue;
     }
 
-		glfwSwapBuffers(window);
+    const std::vector<Rect> &changed = repaint(screen, *Level, tiles, player, camera, dirty, &jobs);
+    stages.add(StageStats::RASTERIZE, std::chrono::duration<double>(std::chrono::steady_clock::now() - rasterize_start).count());
+
+    // the next frame is simulated while this one is shown
+    if (whole_frame) {
+      pipeline.submitAll(screen, inputs);
+    } else {
+      pipeline.submit(screen, changed, inputs);
+    }
+    whole_frame = false;
+    inputs.clear();
+
+    double cpu_now = double(clock()) / CLOCKS_PER_SEC,
+           wall_now = glfwGetTime();
+    stats.frame(dirty.pixels(), pipeline.lastUploadBytes(), cpu_now - cpu_last, wall_now - wall_last);
+    cpu_last = cpu_now;
+    wall_last = wall_now;
+
+    // the latency so far, once a second
+    if (wall_now - title_time >= 1.0) {
+      title_time = wall_now;
+      LatencyHistogram latency = pipeline.inputLatency();
+      if (latency.samples > 0) {
+        char title[128];
+        snprintf(title, sizeof(title), "Escaping The Castle - input latency p50 %.1f ms, p95 %.1f ms, p99 %.1f ms",
+                 latency.percentile(0.50) * 1e3, latency.percentile(0.95) * 1e3, latency.percentile(0.99) * 1e3);
+        glfwSetWindowTitle(window, title);
+      }
+    }
 	}
 
+  // the presenter is deleted with the context current
+  pipeline.finish();
+  glfwMakeContextCurrent(window);
+
+  stats.print(std::cout);
+  stages.merge(pipeline.stages());
+  stages.print(std::cout);
+  pipeline.inputLatency().print(std::cout);
+
+  const ChunkStats &chunks = Level->chunkStats();
+  std::cout << "chunks: " << chunks.hits << " hits, " << chunks.misses << " misses, "
+            << chunks.resident << " resident (" << chunks.resident_bytes / 1024 << " KB)" << std::endl;
+
+  if (replay) {
+    std::cout << "replay: " << replay->checked() << " state hashes checked";
+    if (replay->firstMismatch() >= 0) {
+      std::cout << ", first mismatch after tick " << replay->firstMismatch();
+    }
+    std::cout << std::endl;
+  }
+
 	glfwTerminate();
 	return 0;
 }